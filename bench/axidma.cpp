@@ -0,0 +1,328 @@
+/**
+ * @file
+ * @brief Throughput, CPU load and completion latency of rx() modes
+ *
+ * Sweep rx() mode, block size, ring size, data arrival rate and wait policy on the
+ * simulated AXI DMA (SimBackend) and, when a hardware target is given, on the
+ * real core. Each point runs for a fixed time and reports:
+ * - MB/s, blocks/s (block descriptors or direct transfers) and rx/s (completed rx() calls)
+ * - CPU utilisation of the rx() thread (user + system time over elapsed time)
+ * - completion latency percentiles: time from completion of last block of a transfer
+ *   (SimBackend timestamps) to rx() return; not available on hardware
+ * - blocks overwritten before being consumed (cyclic modes, SimBackend)
+ *
+ * Modes:
+ * - direct: direct register mode, one transfer per rx(), engine restarted after each one
+ * - block: cyclic ring, rx() returns ready blocks without waiting the whole ring
+ * - buffer: cyclic ring, rx() waits completion of the whole ring
+ * - release: non-cyclic ring, blocks are released after each rx() (back-pressure)
+ *
+ * Usage: axidma_bench [-m modes] [-b blocksizes] [-n ndescs] [-r rates] [-w policies] [-t ms]
+ *                     [-H baseaddr -D descaddr -u udmabuf]
+ *
+ * Lists are comma separated; rates in MB/s (0: unlimited), policies busy, spin, fixed,
+ * adaptive, ewma. With -H the sweep runs on hardware (arrival rate is set by the
+ * source, -r is ignored).
+ */
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <cstdint>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "dmactrl.h"
+#include "dmabuffer.h"
+#include "simbackend.h"
+#include "waitpolicy.h"
+
+#define SIM_MEMBASE   0x10000000
+#define RX_TIMEOUT    100000
+
+enum Mode { DIRECT, BLOCK, BUFFER, RELEASE };
+
+static const char *modeNames[] = { "direct", "block", "buffer", "release" };
+
+struct Point {
+   Mode mode;
+   uint32_t blocksize;
+   uint32_t ndesc;
+   double rate;               // MB/s (0: unlimited)
+   std::string policy;
+};
+
+struct Result {
+   double mbs = 0, blocks = 0, rxs = 0, cpu = 0;
+   std::vector<double> latency;   // us
+   uint64_t overruns = 0;
+   bool valid = true;
+};
+
+/*
+ * Wait policy forcing block mode: cyclic rx() returns ready blocks without waiting whole ring
+ */
+class BlockMode : public WaitPolicy {
+
+private:
+   std::unique_ptr<WaitPolicy> policy;
+
+public:
+   BlockMode(std::unique_ptr<WaitPolicy> p) : policy(std::move(p)) {};
+
+   uint32_t next(uint32_t nloops, uint32_t elapsed, uint32_t timeout) override { return policy->next(nloops, elapsed, timeout); };
+   void completed(uint32_t nloops, uint32_t elapsed, uint32_t timeout) override { policy->completed(nloops, elapsed, timeout); };
+   bool lowRate(void) override { return true; };
+};
+
+static std::unique_ptr<WaitPolicy> makePolicy(const std::string &name) {
+
+   if(name == "busy") return std::make_unique<BusyPoll>();
+   if(name == "spin") return std::make_unique<SpinSleep>();
+   if(name == "fixed") return std::make_unique<FixedWait>(100);
+   if(name == "adaptive") return std::make_unique<AdaptiveWait>();
+   if(name == "ewma") return std::make_unique<EWMAWait>();
+
+   return nullptr;
+}
+
+static double cpuTime(void) {
+
+   struct rusage ru;
+   getrusage(RUSAGE_THREAD, &ru);
+
+   return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1e-6;
+}
+
+/*
+ * Configure S2MM channel for a point and call rx() for the given time
+ *
+ * stamp(range) returns completion time of last block of a transfer (epoch: unknown)
+ */
+template<class Backend, typename Stamp>
+static Result measure(DMACtrlT<Backend> &dmac, const Point &p, uint64_t descaddr, uint64_t tgtaddr, unsigned ms, Stamp stamp) {
+
+   Result res;
+   uint64_t bytes = 0, blocks = 0, rxs = 0;
+
+   dmac.setChannel(DMACtrl::S2MM);
+   dmac.reset();
+   dmac.halt();
+
+   std::unique_ptr<WaitPolicy> policy = makePolicy(p.policy);
+   if(p.mode == BLOCK)
+      policy = std::make_unique<BlockMode>(std::move(policy));
+   dmac.setWaitPolicy(std::move(policy));
+
+   if(p.mode == DIRECT) {
+      dmac.initDirect(p.blocksize, tgtaddr);
+   } else {
+      dmac.setCyclic(p.mode != RELEASE);
+      dmac.initSG(descaddr, p.ndesc, p.blocksize, tgtaddr);
+   }
+
+   res.latency.reserve(1 << 20);
+
+   dmac.run();
+
+   double cpu0 = cpuTime();
+   auto start = std::chrono::steady_clock::now();
+   auto end = start + std::chrono::milliseconds(ms);
+   auto now = start;
+
+   while(now < end) {
+
+      bool done = dmac.rx(RX_TIMEOUT);
+      now = std::chrono::steady_clock::now();
+      if(!done)
+         continue;
+
+      DMACtrl::BlockRange range = dmac.getBlockRange();
+      auto t = stamp(range);
+      if(t.time_since_epoch().count() != 0)
+         res.latency.push_back(std::max(0.0, std::chrono::duration<double, std::micro>(now - t).count()));
+
+      bytes += range.bytes;
+      blocks += (p.mode == DIRECT) ? 1 : range.last - range.first + 1;
+      rxs++;
+
+      if(p.mode == DIRECT)
+         dmac.run();
+      else if(p.mode == RELEASE)
+         dmac.release(range);
+   }
+
+   double s = std::chrono::duration<double>(now - start).count();
+   res.cpu = (cpuTime() - cpu0) / s * 100;
+   res.mbs = bytes / s / 1e6;
+   res.blocks = blocks / s;
+   res.rxs = rxs / s;
+
+   dmac.reset();
+
+   return res;
+}
+
+static Result runSim(const Point &p, unsigned ms) {
+
+   uint64_t descaddr = SIM_MEMBASE;
+   uint64_t tgtaddr = SIM_MEMBASE + (((uint64_t) p.ndesc * DESC_SIZE + 4095) & ~4095ULL);
+   size_t memsize = tgtaddr - SIM_MEMBASE + (size_t) p.ndesc * p.blocksize;
+
+   DMACtrlT<SimBackend> dmac(std::make_unique<SimBackend>(SIM_MEMBASE, memsize, p.mode != DIRECT));
+   SimBackend &sim = dmac.getBackend();
+
+   sim.setRate(p.rate * 1e6);
+
+   Result res = measure(dmac, p, descaddr, tgtaddr, ms, [&](const DMACtrl::BlockRange &r) {
+      return (p.mode == DIRECT) ? sim.getCompletionTime() : sim.getCompletionTime(descaddr + (uint64_t) r.last * DESC_SIZE);
+   });
+   res.overruns = sim.getOverruns();
+
+   return res;
+}
+
+static Result runHw(const Point &p, unsigned ms, uint64_t baseaddr, uint64_t descaddr, DMABuffer &dbuf) {
+
+   DMACtrl dmac(baseaddr);
+   Result res;
+
+   dmac.setChannel(DMACtrl::S2MM);
+   if(dmac.isSG() == (p.mode == DIRECT) || (uint64_t) p.ndesc * p.blocksize > dbuf.getBufferSize()) {
+      res.valid = false;
+      return res;
+   }
+
+   dmac.setBuffer(dbuf);
+
+   return measure(dmac, p, descaddr, dbuf.getPhysicalAddress(), ms, [](const DMACtrl::BlockRange &) {
+      return std::chrono::steady_clock::time_point();
+   });
+}
+
+static double percentile(std::vector<double> &v, double q) {
+
+   size_t i = std::min(v.size() - 1, (size_t) (q * (v.size() - 1) + 0.5));
+   std::nth_element(v.begin(), v.begin() + i, v.end());
+
+   return v[i];
+}
+
+static std::vector<std::string> split(const std::string &s) {
+
+   std::vector<std::string> items;
+   std::stringstream ss(s);
+   std::string item;
+
+   while(std::getline(ss, item, ','))
+      if(!item.empty())
+         items.push_back(item);
+
+   return items;
+}
+
+static void print(const Point &p, Result &r, bool hw) {
+
+   std::cout << std::left << std::setw(8) << modeNames[p.mode] << std::right
+      << std::setw(8) << p.blocksize << std::setw(6) << ((p.mode == DIRECT) ? 1 : p.ndesc);
+
+   if(hw) std::cout << std::setw(8) << "-";
+   else if(p.rate > 0) std::cout << std::setw(8) << std::defaultfloat << std::setprecision(6) << p.rate;
+   else std::cout << std::setw(8) << "max";
+
+   std::cout << "  " << std::left << std::setw(9) << p.policy << std::right;
+
+   if(!r.valid) {
+      std::cout << "  (not supported by core or buffer)" << std::endl;
+      return;
+   }
+
+   std::cout << std::fixed << std::setprecision(1)
+      << std::setw(9) << r.mbs << std::setw(11) << r.blocks << std::setw(10) << r.rxs << std::setw(7) << r.cpu;
+
+   if(r.latency.empty()) {
+      std::cout << std::setw(9) << "-" << std::setw(9) << "-" << std::setw(9) << "-" << std::setw(9) << "-";
+   } else {
+      std::cout << std::setw(9) << percentile(r.latency, 0.5) << std::setw(9) << percentile(r.latency, 0.99)
+         << std::setw(9) << percentile(r.latency, 0.999) << std::setw(9) << *std::max_element(r.latency.begin(), r.latency.end());
+   }
+
+   std::cout << std::setw(10) << r.overruns << std::defaultfloat << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+
+   std::vector<std::string> modes = { "direct", "block", "buffer", "release" };
+   std::vector<std::string> blocksizes = { "4096", "65536" };
+   std::vector<std::string> ndescs = { "16", "256" };
+   std::vector<std::string> rates = { "50", "400", "0" };
+   std::vector<std::string> policies = { "busy", "adaptive", "ewma" };
+   unsigned ms = 200;
+   uint64_t baseaddr = 0, descaddr = 0;
+   std::string udmabuf;
+   bool hw = false;
+   int opt;
+
+   while((opt = getopt(argc, argv, "m:b:n:r:w:t:H:D:u:")) != -1) {
+      switch(opt) {
+         case 'm': modes = split(optarg); break;
+         case 'b': blocksizes = split(optarg); break;
+         case 'n': ndescs = split(optarg); break;
+         case 'r': rates = split(optarg); break;
+         case 'w': policies = split(optarg); break;
+         case 't': ms = std::strtoul(optarg, nullptr, 0); break;
+         case 'H': baseaddr = std::strtoull(optarg, nullptr, 0); hw = true; break;
+         case 'D': descaddr = std::strtoull(optarg, nullptr, 0); break;
+         case 'u': udmabuf = optarg; break;
+         default:
+            std::cout << "usage: " << argv[0] << " [-m modes] [-b blocksizes] [-n ndescs] [-r rates] [-w policies] [-t ms] [-H baseaddr -D descaddr -u udmabuf]" << std::endl;
+            return 1;
+      }
+   }
+
+   DMABuffer dbuf;
+   if(hw && !dbuf.open(udmabuf, false)) {
+      std::cout << "E: can not open udmabuf " << udmabuf << std::endl;
+      return 1;
+   }
+   if(hw)
+      rates = { "0" };
+
+   std::vector<Point> points;
+   for(auto &m : modes) {
+      auto mode = std::find(std::begin(modeNames), std::end(modeNames), m);
+      if(mode == std::end(modeNames)) {
+         std::cout << "E: unknown mode " << m << std::endl;
+         return 1;
+      }
+      for(auto &w : policies) {
+         if(!makePolicy(w)) {
+            std::cout << "E: unknown wait policy " << w << std::endl;
+            return 1;
+         }
+         for(auto &b : blocksizes)
+            for(size_t n=0; n < ndescs.size(); n++)
+               for(auto &r : rates) {
+                  // direct mode has no ring
+                  if(*mode == std::string("direct") && n > 0)
+                     continue;
+                  points.push_back(Point{ (Mode) (mode - std::begin(modeNames)), (uint32_t) std::stoul(b),
+                     (uint32_t) std::stoul(ndescs[n]), std::stod(r), w });
+               }
+      }
+   }
+
+   std::cout << "mode    blocksz ndesc    rate  policy        MB/s   blocks/s      rx/s   cpu%  p50(us)  p99(us) p999(us)  max(us)  overruns" << std::endl;
+
+   for(auto &p : points) {
+      Result r = hw ? runHw(p, ms, baseaddr, descaddr, dbuf) : runSim(p, ms);
+      print(p, r, hw);
+   }
+
+   return 0;
+}
@@ -0,0 +1,77 @@
+/**
+ * @file
+ * @brief Polls per second with static and virtual backend dispatch
+ *
+ * Compare a bare volatile DMASR load with DMACtrl polls through MMIOBackend
+ * (static dispatch, DMACtrl) and through the DMABackend interface (virtual
+ * call per register access). A plain file stands in for /dev/mem: registers
+ * report a running scatter-gather S2MM channel with no completed descriptor,
+ * so each tryComplete() is a full empty poll (DMASR and BD STATUS reads).
+ */
+#include <iostream>
+#include <chrono>
+#include <cstdint>
+#include <unistd.h>
+
+#include "dmactrl.h"
+
+#define DEVSIZE   (1 << 20)
+#define DESCADDR  0x10000
+#define NDESC     64
+#define BLOCKSIZE 8192
+#define NPOLLS    20000000UL
+
+template<typename F>
+static void run(const char *label, F poll) {
+
+   uint32_t acc = 0;
+   auto start = std::chrono::steady_clock::now();
+   for(unsigned long i=0; i<NPOLLS; i++)
+      acc += poll();
+   auto stop = std::chrono::steady_clock::now();
+
+   double s = std::chrono::duration<double>(stop - start).count();
+   std::cout << label << ": " << s * 1e9 / NPOLLS << " ns/poll, " << NPOLLS / s / 1e6 << " Mpolls/s (" << (acc & 1) << ")" << std::endl;
+}
+
+template<class Backend>
+static void runCtrl(const char *label, DMACtrlT<Backend> &dmac) {
+
+   DMACtrl::BlockRange range;
+   std::string l(label);
+
+   dmac.setChannel(DMACtrl::S2MM);
+   dmac.initSG(DESCADDR, NDESC, BLOCKSIZE, 0x20000000);
+   dmac.run();
+
+   run((l + " isIdle     ").data(), [&]() { return dmac.isIdle(DMACtrl::S2MM); });
+   run((l + " tryComplete").data(), [&]() { return dmac.tryComplete(range); });
+}
+
+int main(void) {
+
+   char devname[] = "/tmp/axidma_simXXXXXX";
+   int h = mkstemp(devname);
+   if(h < 0 || ftruncate(h, DEVSIZE) != 0) {
+      std::cout << "E: can not create simulated device" << std::endl;
+      return 1;
+   }
+
+   // S2MM DMASR: SGIncld
+   uint32_t dmasr = 0x0008;
+   pwrite(h, &dmasr, sizeof(dmasr), DMACtrl::regOffset<DMACtrl::S2MM>(DMACtrl::DMASR));
+   close(h);
+
+   MMIOBackend raw(0, devname);
+   run("volatile load       ", [&]() { return raw.readRegister(DMACtrl::regOffset<DMACtrl::S2MM>(DMACtrl::DMASR)) & 0x0002; });
+
+   DMACtrl dmac(0, devname);
+   runCtrl("static ", dmac);
+
+   DMACtrlT<DMABackend> vdmac(std::make_unique<MMIOBackend>(0, devname));
+   runCtrl("virtual", vdmac);
+
+   unlink(devname);
+
+   return 0;
+}
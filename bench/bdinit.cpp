@@ -0,0 +1,84 @@
+/**
+ * @file
+ * @brief Cost of scatter-gather ring (re)initialization
+ *
+ * Compare the former word by word descriptor initialization (including the
+ * byte offset zeroing loop) with descriptors built in a local array and
+ * stored with 64 bit writes, on a simulated (plain memory) descriptor area.
+ */
+#include <iostream>
+#include <chrono>
+#include <cstdint>
+
+#include "dmactrl.h"
+
+#define NDESC     4096
+#define NLOOPS    200
+#define BLOCKSIZE 8192
+
+alignas(DESC_SIZE) static volatile uint32_t bdmem[NDESC * DESC_SIZE / 4];
+
+static const uint32_t descaddr = 0x40000000;
+static const uint32_t targetaddr = 0x10000000;
+
+static void setMem(volatile uint32_t *mem_address, uint32_t offset, uint32_t value) {
+   mem_address[offset>>2] = value;
+}
+
+// descriptor initialization as done before batched stores
+static void wordInit(void) {
+
+   uint32_t i;
+
+   for(i=0; i < (DESC_SIZE * NDESC); i++)
+      setMem(bdmem, i, 0);
+
+   for(i=0; i<NDESC; i++) {
+      setMem(bdmem, NXTDESC + (DESC_SIZE * i), descaddr + NXTDESC + (DESC_SIZE * (i+1)));
+      setMem(bdmem, BUFFER_ADDRESS + (DESC_SIZE * i), targetaddr + (BLOCKSIZE * i));
+      setMem(bdmem, CONTROL + (DESC_SIZE * i), BLOCKSIZE);
+   }
+
+   setMem(bdmem, NXTDESC + (DESC_SIZE * (NDESC-1)), descaddr);
+}
+
+// descriptors built in a local array and stored in batches
+static void batchInit(void) {
+
+   DMACtrl::Descriptor batch[DESC_BATCH];
+   uint32_t n = 0;
+
+   for(uint32_t i=0; i<NDESC; i++) {
+
+      DMACtrl::Descriptor &bd = batch[n++];
+      bd = DMACtrl::Descriptor{};
+      bd.nxtdesc = (i == NDESC-1) ? descaddr : descaddr + (DESC_SIZE * (i+1));
+      bd.bufferAddress = targetaddr + (BLOCKSIZE * i);
+      bd.control = BLOCKSIZE;
+
+      if(n == DESC_BATCH || i == NDESC-1) {
+         DMACtrl::storeDescriptors(bdmem, i + 1 - n, batch, n);
+         n = 0;
+      }
+   }
+}
+
+template<typename F>
+static void run(const char *label, F init) {
+
+   auto start = std::chrono::steady_clock::now();
+   for(unsigned long i=0; i<NLOOPS; i++)
+      init();
+   auto stop = std::chrono::steady_clock::now();
+
+   double us = std::chrono::duration<double, std::micro>(stop - start).count() / NLOOPS;
+   std::cout << label << ": " << us << " us/ring (" << NDESC << " BDs, " << (bdmem[NXTDESC>>2] & 1) << ")" << std::endl;
+}
+
+int main(void) {
+
+   run("word by word ", wordInit);
+   run("batched 64bit", batchInit);
+
+   return 0;
+}
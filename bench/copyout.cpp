@@ -0,0 +1,72 @@
+/**
+ * @file
+ * @brief Throughput of copy-out from DMA buffer to cached memory
+ *
+ * Compare DMABuffer::streamCopy() with memcpy and a per uint16_t element loop.
+ * With a udmabuf name as argument the buffer is opened uncached (O_SYNC),
+ * otherwise plain memory is used as source.
+ *
+ * usage: copyout_bench [udmabuf name]
+ */
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+
+#include "dmabuffer.h"
+
+#define BLOCKSIZE (1 << 20)
+#define NLOOPS    50
+
+template<typename F>
+static void run(const char *label, F copy) {
+
+   auto start = std::chrono::steady_clock::now();
+   for(int i=0; i<NLOOPS; i++)
+      copy();
+   auto stop = std::chrono::steady_clock::now();
+
+   double s = std::chrono::duration<double>(stop - start).count();
+   std::cout << label << ": " << (double) BLOCKSIZE * NLOOPS / s / 1e6 << " MB/s" << std::endl;
+}
+
+int main(int argc, char **argv) {
+
+   DMABuffer dbuf;
+   std::vector<uint8_t> plain;
+   const uint8_t *src;
+
+   if(argc > 1) {
+      if(!dbuf.open(argv[1], false) || dbuf.getBufferSize() < BLOCKSIZE) {
+         std::cout << "E: can not use " << argv[1] << std::endl;
+         return 1;
+      }
+      src = dbuf.buf;
+   } else {
+      plain.resize(BLOCKSIZE);
+      for(size_t i=0; i<plain.size(); i++)
+         plain[i] = (uint8_t) i;
+      src = plain.data();
+   }
+
+   std::vector<uint8_t> dst(BLOCKSIZE);
+
+   run("uint16_t loop", [&]() {
+      const volatile uint16_t *s = (const volatile uint16_t *) src;
+      uint16_t *d = (uint16_t *) dst.data();
+      for(size_t i=0; i<BLOCKSIZE/2; i++)
+         d[i] = s[i];
+   });
+   run("memcpy       ", [&]() { std::memcpy(dst.data(), src, BLOCKSIZE); });
+   run("streamCopy   ", [&]() { DMABuffer::streamCopy(dst.data(), src, BLOCKSIZE); });
+
+   // unaligned head/tail
+   DMABuffer::streamCopy(dst.data(), src + 3, BLOCKSIZE - 10);
+   if(std::memcmp(dst.data(), src + 3, BLOCKSIZE - 10) != 0) {
+      std::cout << "E: streamCopy mismatch" << std::endl;
+      return 1;
+   }
+
+   return 0;
+}
@@ -0,0 +1,52 @@
+/**
+ * @file
+ * @brief Per-poll cost of DMASR status read
+ *
+ * Compare the former string keyed register map lookup with the
+ * compile-time register layout on a mocked (plain memory) register block.
+ */
+#include <iostream>
+#include <map>
+#include <string>
+#include <chrono>
+#include <cstdint>
+
+#include "dmactrl.h"
+
+#define NPOLLS    50000000UL
+
+static volatile uint32_t regblock[AXI_DMA_DEPTH >> 2];
+
+template<typename F>
+static void run(const char *label, F poll) {
+
+   uint32_t acc = 0;
+   auto start = std::chrono::steady_clock::now();
+   for(unsigned long i=0; i<NPOLLS; i++)
+      acc += poll();
+   auto stop = std::chrono::steady_clock::now();
+
+   double ns = std::chrono::duration<double, std::nano>(stop - start).count() / NPOLLS;
+   std::cout << label << ": " << ns << " ns/poll (" << (acc & 1) << ")" << std::endl;
+}
+
+int main(void) {
+
+   // register map as used before compile-time layout
+   std::map<std::string, uint8_t> regs = {
+      {"DMACR", 0x30},
+      {"DMASR", 0x34},
+      {"DESTINATION_ADDRESS", 0x48},
+      {"LENGTH", 0x58},
+      {"CURDESC", 0x38},
+      {"TAILDESC", 0x40} };
+
+   volatile uint32_t *mem = regblock;
+   volatile uint32_t *chmem = mem + (DMACtrl::channelBase(DMACtrl::S2MM) >> 2);
+
+   run("std::map lookup   ", [&]() { return mem[regs["DMASR"]>>2] & 0x0002; });
+   run("channel base      ", [&]() { return chmem[DMACtrl::DMASR>>2] & 0x0002; });
+   run("constexpr offset  ", [&]() { return mem[DMACtrl::regOffset<DMACtrl::S2MM>(DMACtrl::DMASR)>>2] & 0x0002; });
+
+   return 0;
+}
@@ -0,0 +1,106 @@
+/**
+ * @file
+ * @brief Cost and resource balance of engine restarts
+ *
+ * Repeatedly create a controller, initialize and start a scatter-gather ring,
+ * reinitialize it (run configuration change), move the controller and destroy it.
+ * A plain file stands in for /dev/mem (simulated device): mappings and file
+ * descriptors of the process are counted before and after the loop and any
+ * growth is reported as a leak.
+ *
+ * usage: restart_bench [loops]
+ */
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <unistd.h>
+
+#include "dmactrl.h"
+
+#define DEVSIZE   (1 << 20)
+#define DESCADDR  0x10000
+#define NDESC     1024
+#define BLOCKSIZE 8192
+
+static size_t countMaps(void) {
+
+   std::ifstream f("/proc/self/maps");
+   std::string line;
+   size_t n = 0;
+
+   while(std::getline(f, line))
+      n++;
+
+   return n;
+}
+
+static size_t countFds(void) {
+
+   size_t n = 0;
+   for(auto &e : std::filesystem::directory_iterator("/proc/self/fd")) {
+      (void) e;
+      n++;
+   }
+
+   return n;
+}
+
+// one restart cycle of a run
+static void cycle(const char *devname) {
+
+   DMACtrl dmac(0, devname);
+   dmac.setChannel(DMACtrl::S2MM);
+   dmac.initSG(DESCADDR, NDESC, BLOCKSIZE, 0x20000000);
+   dmac.run();
+   dmac.fd();
+
+   // new run configuration: ring mapping is reused
+   dmac.halt();
+   dmac.initSG(DESCADDR, NDESC / 2, 2 * BLOCKSIZE, 0x20000000);
+   dmac.run();
+
+   DMACtrl moved(std::move(dmac));
+   moved.halt();
+}
+
+int main(int argc, char **argv) {
+
+   unsigned long nloops = (argc > 1) ? std::strtoul(argv[1], nullptr, 0) : 10000;
+
+   char devname[] = "/tmp/axidma_simXXXXXX";
+   int h = mkstemp(devname);
+   if(h < 0 || ftruncate(h, DEVSIZE) != 0) {
+      std::cout << "E: can not create simulated device" << std::endl;
+      return 1;
+   }
+
+   // S2MM DMASR: SGIncld
+   uint32_t dmasr = 0x0008;
+   pwrite(h, &dmasr, sizeof(dmasr), DMACtrl::regOffset<DMACtrl::S2MM>(DMACtrl::DMASR));
+   close(h);
+
+   // first cycle allocates per process resources (thread stack cache, malloc arena)
+   cycle(devname);
+
+   size_t maps = countMaps();
+   size_t fds = countFds();
+
+   auto start = std::chrono::steady_clock::now();
+   for(unsigned long i=0; i<nloops; i++)
+      cycle(devname);
+   auto stop = std::chrono::steady_clock::now();
+
+   size_t leakedMaps = countMaps() - maps;
+   size_t leakedFds = countFds() - fds;
+   unlink(devname);
+
+   double us = std::chrono::duration<double, std::micro>(stop - start).count() / nloops;
+   std::cout << "restart: " << us << " us/cycle (" << nloops << " cycles, " << NDESC << " BDs)" << std::endl;
+   std::cout << "leaked mappings: " << leakedMaps << ", leaked file descriptors: " << leakedFds << std::endl;
+
+   return (leakedMaps || leakedFds) ? 1 : 0;
+}
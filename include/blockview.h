@@ -0,0 +1,84 @@
+/** @file */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+
+/**
+ * @brief Read-only view of contiguous elements
+ *
+ * Minimal span (C++17) used to access DMA data in place.
+ */
+template<typename T>
+class ConstSpan {
+
+private:
+   const T *ptr;
+   size_t len;
+
+public:
+   ConstSpan(void) : ptr(nullptr), len(0) {};
+   ConstSpan(const T *data, size_t count) : ptr(data), len(count) {};
+
+   /** Get pointer to first element */
+   const T *data(void) const { return ptr; };
+   /** Get number of elements */
+   size_t size(void) const { return len; };
+   /** Get size in bytes */
+   size_t size_bytes(void) const { return len * sizeof(T); };
+   /** Get true if view is empty */
+   bool empty(void) const { return (len == 0); };
+   const T &operator[](size_t i) const { return ptr[i]; };
+   const T *begin(void) const { return ptr; };
+   const T *end(void) const { return ptr + len; };
+};
+
+/**
+ * @brief Packet (frame delimited by TLAST) inside a DMA transfer
+ *
+ * A packet spans one or more consecutive block descriptors: all descriptors but
+ * the last one are full, so packet data is contiguous.
+ * A frame crossing the ring end (or a ring segment end) is not contiguous: it is
+ * reported in two consecutive transfers, as a packet with eof cleared followed by
+ * a packet with sof cleared.
+ */
+struct Packet {
+   uint32_t offset;   ///< offset of packet data from start of transfer
+   uint32_t size;     ///< packet size (transferred bytes)
+   uint32_t first;    ///< first block descriptor index
+   uint32_t last;     ///< last block descriptor index
+   bool sof;          ///< packet starts in this transfer (RXSOF)
+   bool eof;          ///< packet ends in this transfer (RXEOF)
+};
+
+/**
+ * @brief Zero-copy view of a DMA transfer
+ *
+ * Data points directly into the DMA buffer mapping: the view is valid until the
+ * related block descriptors are reused by the DMA engine.
+ */
+struct BlockView {
+
+   ConstSpan<std::byte> bytes;   ///< transferred data
+   ConstSpan<uint32_t> lengths;  ///< transferred bytes of each block descriptor (valid until next transfer)
+   ConstSpan<Packet> packets;    ///< packets included in transfer (valid until next transfer)
+   uint32_t first = 0;           ///< first block descriptor index
+   uint32_t last = 0;            ///< last block descriptor index
+   uint32_t offset = 0;          ///< offset of data in DMA buffer
+   uint32_t segment = 0;         ///< ring segment (DMA buffer) holding data
+   uint64_t sequence = 0;        ///< transfer sequence number (from 0 after reset() or initialization)
+   std::chrono::steady_clock::time_point timestamp;   ///< completion detection time
+
+   /** Get data as typed elements (e.g. as<uint16_t>() for 16 bit samples) */
+   template<typename T>
+   ConstSpan<T> as(void) const { return ConstSpan<T>(reinterpret_cast<const T *>(bytes.data()), bytes.size() / sizeof(T)); };
+   /** Get data of a packet */
+   ConstSpan<std::byte> packet(const Packet &p) const { return ConstSpan<std::byte>(bytes.data() + p.offset, p.size); };
+   /** Get pointer to data */
+   const std::byte *data(void) const { return bytes.data(); };
+   /** Get size of data */
+   size_t size(void) const { return bytes.size(); };
+   /** Get true if view is empty */
+   bool empty(void) const { return bytes.empty(); };
+};
@@ -0,0 +1,78 @@
+/** @file */
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+#include "memmap.h"
+
+/**
+ * @brief Access to AXI DMA registers and block descriptors memory
+ *
+ * DMACtrl reads and writes registers and gets block descriptors memory through a
+ * backend, so the same controller logic runs on hardware (MMIOBackend) or on a
+ * software model of the engine (SimBackend).
+ */
+class DMABackend {
+
+public:
+   virtual ~DMABackend(void) {};
+
+   /**
+   * @brief Read a register
+   *
+   * @param offset register offset from AXI DMA base address
+   * @return value
+   */
+   virtual uint32_t readRegister(uint32_t offset) = 0;
+
+   /**
+   * @brief Write a register
+   *
+   * @param offset register offset from AXI DMA base address
+   * @param value value
+   */
+   virtual void writeRegister(uint32_t offset, uint32_t value) = 0;
+
+   /**
+   * @brief Get block descriptors memory of a channel
+   *
+   * A previous area of the same channel can be released (or reused if it covers the new one).
+   *
+   * @param ch channel index (0: MM2S, 1: S2MM)
+   * @param addr physical address of block descriptors
+   * @param size size of block descriptors area
+   *
+   * @return pointer to block descriptors (nullptr: area not available)
+   */
+   virtual volatile uint32_t *mapDescriptors(unsigned ch, uint64_t addr, size_t size) = 0;
+
+   /**
+   * @brief Release block descriptors memory of a channel (descriptors moved to a DMA buffer)
+   *
+   * @param ch channel index (0: MM2S, 1: S2MM)
+   */
+   virtual void unmapDescriptors(unsigned ch) {};
+};
+
+/**
+ * @brief AXI DMA registers and block descriptors memory mapped from /dev/mem
+ */
+class MMIOBackend final : public DMABackend {
+
+private:
+   FileHandle dh;
+   MemMap regmap;
+   MemMap bdmap[2];
+   uint64_t bdaddr[2] = { 0, 0 };
+   volatile uint32_t *mem;
+
+public:
+   MMIOBackend(uint64_t baseaddr, std::string devname = "/dev/mem");
+
+   uint32_t readRegister(uint32_t offset) override { return mem[offset>>2]; };
+   void writeRegister(uint32_t offset, uint32_t value) override { mem[offset>>2] = value; };
+   volatile uint32_t *mapDescriptors(unsigned ch, uint64_t addr, size_t size) override;
+   void unmapDescriptors(unsigned ch) override { bdmap[ch].unmap(); };
+};
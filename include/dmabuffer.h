@@ -2,10 +2,19 @@
 #pragma once
 
 #include <string>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "memmap.h"
 
 #define  CPU_OWNER               0x01
 #define  DEVICE_OWNER            0x02
 
+#define  DMA_BIDIRECTIONAL       0x00
+#define  DMA_TO_DEVICE           0x01
+#define  DMA_FROM_DEVICE         0x02
+
 /**
  * @brief User space DMA buffer
  *
@@ -14,29 +23,81 @@
  */
 class DMABuffer {
 
+public:
+   /**
+   * @brief Area of the buffer copied to a destination (scatter copy)
+   */
+   struct CopyRegion {
+      uint32_t offset;  ///< offset of data in buffer
+      uint32_t size;    ///< size of data
+      void *dst;        ///< destination (cached memory)
+   };
+
+   /**
+   * @brief Cache sync interface
+   */
+   enum SyncMethod {
+      SYNC_AUTO,     ///< ioctl if supported by driver, otherwise sysfs (detected at first sync)
+      SYNC_IOCTL,    ///< U_DMA_BUF_IOCTL_SET_SYNC_FOR_CPU/DEVICE on device node
+      SYNC_SYSFS     ///< sync_offset, sync_size, sync_direction, sync_for_cpu/device attributes
+   };
+
 private:
    std::string    name;
    std::string    sys_class_path;
-   int            fd;
+   std::string    dev_dir;
+   std::vector<std::string> sys_class_dirs;
+   FileHandle     fd;
+   MemMap         bufmap;
    uint32_t       buf_size;
-   uint32_t       phys_addr;
+   uint64_t       phys_addr;
    uint8_t        sync_mode;
    bool           cache_on;
 
+   // sysfs sync attributes kept open for the lifetime of the buffer
+   enum SyncAttr { SYNC_OFFSET, SYNC_SIZE, SYNC_DIRECTION, SYNC_FOR_CPU, SYNC_FOR_DEVICE, SYNC_MODE, SYNC_NATTR };
+   FileHandle     sync_fd[SYNC_NATTR];
+   uint64_t       sync_value[SYNC_DIRECTION+1];     // last written offset, size, direction
+
+   SyncMethod     sync_method;
+
+   bool writeAttr(SyncAttr attr, uint64_t value);
+   bool sync(uint8_t owner, uint32_t offset, uint32_t size, uint8_t direction);
+
 public:
    DMABuffer(void);
    ~DMABuffer(void);
 
+   DMABuffer(const DMABuffer &) = delete;
+   DMABuffer &operator=(const DMABuffer &) = delete;
+   DMABuffer(DMABuffer &&other) noexcept;
+   DMABuffer &operator=(DMABuffer &&other) noexcept;
+
    uint8_t *buf;     ///< Buffer for data transfer
 
    bool open(std::string bufname, bool cache_on);
+   void setDeviceDirs(std::string devdir, std::string sysclassdir = "");
    bool close(void);
+   /** Get true if udmabuf is open */
+   bool isOpen(void) { return (bool) fd; };
    /** Get physical address of udmabuf buffer */
-   uint32_t getPhysicalAddress(void) { return phys_addr; };
+   uint64_t getPhysicalAddress(void) { return phys_addr; };
    /** Get size of udmabuf buffer */
    uint32_t getBufferSize(void) { return buf_size; };
+   /** Get true if CPU cache is enabled on udmabuf buffer (explicit sync needed) */
+   bool isCacheOn(void) { return cache_on; };
    bool setSyncArea(uint32_t offset, uint32_t size, uint8_t direction);
    bool setBufferOwner(uint8_t owner);
    bool setSyncMode(uint8_t mode);
+   bool syncForCpu(uint32_t offset, uint32_t size, uint8_t direction = DMA_FROM_DEVICE);
+   bool syncForDevice(uint32_t offset, uint32_t size, uint8_t direction = DMA_TO_DEVICE);
+   /** Set cache sync interface (default SYNC_AUTO) */
+   void setSyncMethod(SyncMethod method) { sync_method = method; };
+   /** Get cache sync interface (SYNC_AUTO until first sync) */
+   SyncMethod getSyncMethod(void) { return sync_method; };
+
+   bool copyOut(uint32_t offset, uint32_t size, void *dst);
+   bool copyOut(const std::vector<CopyRegion> &regions);
+   static void streamCopy(void *dst, const void *src, size_t size);
 };
 
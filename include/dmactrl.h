@@ -1,9 +1,19 @@
 /** @file */
 #pragma once
 
-#include <map>
 #include <string>
 #include <cstdint>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <vector>
+#include <type_traits>
+
+#include "waitpolicy.h"
+#include "blockview.h"
+#include "dmabackend.h"
+
+class DMABuffer;
 
 /**
  * @defgroup BD_GROUP Block descriptor registers
@@ -13,33 +23,50 @@
 
 /** Next block descriptor address */
 #define NXTDESC                  0x00
+/** Next block descriptor address (upper 32 bits) */
+#define NXTDESC_MSB              0x04
 /** Memory address for data transfer */
-#define BUFFER_ADDRESS           0x08 
+#define BUFFER_ADDRESS           0x08
+/** Memory address for data transfer (upper 32 bits) */
+#define BUFFER_ADDRESS_MSB       0x0C
 /** Control register */
 #define CONTROL                  0x18
 /** Status register */
-#define STATUS                   0x1C      /// unused with 32bit addresses
+#define STATUS                   0x1C
+/** Control register: start of frame (first descriptor of a packet) */
+#define BD_CONTROL_SOF           (1 << 27)
+/** Control register: end of frame (last descriptor of a packet) */
+#define BD_CONTROL_EOF           (1 << 26)
+/** Status register: descriptor completed */
+#define BD_STATUS_CMPLT          (1u << 31)
+/** Status register: start of frame (RXSOF) */
+#define BD_STATUS_SOF            (1 << 27)
+/** Status register: end of frame (RXEOF) */
+#define BD_STATUS_EOF            (1 << 26)
+/** Status register: DMADecErr, DMASlvErr, DMAIntErr */
+#define BD_STATUS_ERR            (7u << 28)
+/** Control/Status register: buffer length / transferred bytes */
+#define BD_LENGTH_MASK           0x03FFFFFF
 /** Size of block descriptor */
 #define DESC_SIZE                64
+/** Number of block descriptors built in a local array before being stored */
+#define DESC_BATCH               32
+/** Maximum value of DMACR IRQThreshold field */
+#define IRQ_THRESHOLD_MAX        255
 
 /** @} */
 
 #define AXI_DMA_DEPTH            0xFFFF
 
+/** DMASR error flags (DMAIntErr, DMASlvErr, DMADecErr, SGIntErr, SGSlvErr, SGDecErr) */
+#define DMASR_ERR                0x00000770
+
 /**
- * @brief AXI DMA controller
- *
- * Manage AXI DMA controller providing methods for status control (halt, run, reset)
- * and data transfer from/to FPGA
- *
+ * @brief Channels, registers and descriptor layout shared by AXI DMA controllers of any backend
  */
+class DMACtrlBase {
 
-class DMACtrl {
-   
 public:
-   DMACtrl(uint32_t baseaddr);
-   ~DMACtrl(void);
-
    /**
    * @brief DMA channel
    *
@@ -50,88 +77,325 @@ public:
      UNKNOWN  ///< default value before initialization
    };
 
-   void setChannel(DMACtrl::Channel ch);
+   /**
+   * @brief Channel register offsets
+   *
+   * Offsets are relative to the channel register block: MM2S block starts at 0x00,
+   * S2MM block starts at 0x30 (see channelBase())
+   */
+   enum Register : uint8_t {
+      DMACR    = 0x00,  ///< Control register
+      DMASR    = 0x04,  ///< Status register
+      CURDESC  = 0x08,  ///< Current descriptor pointer (scatter-gather)
+      CURDESC_MSB  = 0x0C,  ///< Current descriptor pointer, upper 32 bits
+      TAILDESC = 0x10,  ///< Tail descriptor pointer (scatter-gather)
+      TAILDESC_MSB = 0x14,  ///< Tail descriptor pointer, upper 32 bits
+      ADDRESS  = 0x18,  ///< Source (MM2S) or destination (S2MM) address (direct)
+      ADDRESS_MSB  = 0x1C,  ///< Source or destination address, upper 32 bits
+      LENGTH   = 0x28   ///< Transfer length (direct)
+   };
+
+   /** Get offset of channel register block */
+   static constexpr uint8_t channelBase(Channel ch) { return (ch == S2MM) ? 0x30 : 0x00; }
+   /** Get offset of a channel register resolved at compile time */
+   template<Channel ch>
+   static constexpr uint8_t regOffset(Register reg) { return channelBase(ch) + reg; }
+
+   /**
+   * @brief Range of block descriptors returned by a DMA transfer
+   */
+   struct BlockRange {
+      uint32_t first;   ///< first block descriptor index
+      uint32_t last;    ///< last block descriptor index
+      uint32_t offset;  ///< offset of data in target buffer
+      uint32_t size;    ///< size of data (from first descriptor buffer to the end of last descriptor data)
+      uint32_t bytes;   ///< transferred bytes (sum of descriptors transferred bytes)
+      uint32_t segment; ///< ring segment (DMA buffer) of data, offset is relative to segment start
+   };
+
+   /**
+   * @brief Block descriptor layout (a descriptor fills a cache line)
+   */
+   struct alignas(DESC_SIZE) Descriptor {
+      uint32_t nxtdesc, nxtdescMsb;                ///< NXTDESC, NXTDESC_MSB
+      uint32_t bufferAddress, bufferAddressMsb;    ///< BUFFER_ADDRESS, BUFFER_ADDRESS_MSB
+      uint32_t reserved[2];
+      uint32_t control, status;                    ///< CONTROL, STATUS
+      uint32_t app[5];                             ///< APP0..APP4 (user application fields)
+      uint32_t pad[3];
+   };
+
+   static void storeDescriptors(volatile uint32_t *bdmem, uint32_t first, const Descriptor *bds, uint32_t n);
+
+protected:
+
+   /*
+    * Contiguous target area of a descriptor ring: BDs [first, first+count) point to
+    * consecutive blocks starting from addr
+    */
+   struct Segment {
+      DMABuffer *buffer;                     // DMA buffer of area (nullptr: buffer bound by setBuffer())
+      uint64_t addr;
+      uint32_t first, count;
+   };
+
+   /*
+    * State of a DMA channel
+    */
+   struct ChannelState {
+      volatile uint32_t* bdmem = nullptr;    // block descriptors memory (SG)
+      DMABuffer *descbuf = nullptr;          // DMA buffer holding block descriptors (nullptr: backend memory)
+      int irqfd = -1;                        // UIO (or compatible) interrupt file descriptor
+      bool irqfdOwned = false;
+      int evfd = -1;                         // eventfd signaled by poller thread
+      std::thread poller;
+      std::unique_ptr<WaitPolicy> policy;
+      DMABuffer *buffer = nullptr;           // DMA buffer bound to target address
+      uint32_t size = 0;
+      uint64_t descaddr = 0;
+      uint64_t targetaddr = 0;
+      uint32_t ndesc = 0;
+      std::vector<Segment> segments;         // ring segments, a completed transfer never spans two of them
+      uint32_t blockOffset = 0, blockSize = 0, blockBytes = 0;
+      std::vector<uint32_t> lengths;         // transferred bytes of each BD (S2MM)
+      std::vector<uint8_t> frames;           // RXSOF/RXEOF flags of each BD (S2MM)
+      std::vector<Packet> packets;           // packets of last transfer
+      bool packetMode = false;
+      bool autoSync = false;                 // cache sync of received blocks (S2MM)
+      bool syncPending = false;              // last block (cyclic mode) not yet given back to device
+      uint32_t syncSegment = 0, syncOffset = 0, syncSize = 0;
+      uint32_t blockFirst = 0, blockLast = 0, blockSegment = 0;
+      uint64_t sequence = 0, blockSequence = 0;
+      std::chrono::steady_clock::time_point blockTime;
+      uint32_t bdStartIndex = 0;             // first BD not yet handed out
+      uint32_t scanned = 0;                  // completed BDs found from bdStartIndex
+      bool cyclic = true;                    // S2MM cyclic mode, otherwise BDs are released by consumer
+      uint32_t held = 0;                     // BDs handed out and not released
+      uint32_t releaseIndex = 0;             // next BD to be released
+      uint32_t txHead = 0, txTail = 0, txCount = 0, txNeeded = 0;
+      bool txPending = false;
+      bool directReported = true;            // direct mode transfer already returned, until next run()
+      bool initsg = false;
+      bool blockTransfer = false, bufferTransfer = false;
+   };
+};
+
+/**
+ * @brief AXI DMA controller
+ *
+ * Manage AXI DMA controller providing methods for status control (halt, run, reset)
+ * and data transfer from/to FPGA
+ *
+ * Register and block descriptors memory accesses are dispatched at compile time to the
+ * Backend type: with MMIOBackend (DMACtrl) they inline to bare volatile loads/stores,
+ * SimBackend runs on a software model of the core, DMABackend accepts any backend
+ * through virtual calls (e.g. recording backends in tests).
+ *
+ * @tparam Backend MMIOBackend, SimBackend or DMABackend (member functions are instantiated in the library)
+ */
+template<class Backend>
+class DMACtrlT : public DMACtrlBase {
+   
+public:
+   /** Create controller on registers mapped from memory device (MMIOBackend) */
+   template<class B = Backend, typename = std::enable_if_t<std::is_constructible<B, uint64_t, std::string>::value>>
+   DMACtrlT(uint64_t baseaddr, std::string devname = "/dev/mem") : DMACtrlT(std::make_unique<Backend>(baseaddr, devname)) {};
+   explicit DMACtrlT(std::unique_ptr<Backend> backend);
+   ~DMACtrlT(void);
+
+   DMACtrlT(const DMACtrlT &) = delete;
+   DMACtrlT &operator=(const DMACtrlT &) = delete;
+   DMACtrlT(DMACtrlT &&other) noexcept;
+   DMACtrlT &operator=(DMACtrlT &&other) noexcept;
+
+
+   void setChannel(Channel ch);
+   /** Get selected channel */
+   Channel getChannel(void) { return channel; };
    void setRegister(uint8_t offset, uint32_t value);
    uint32_t getRegister(uint8_t offset);
+   /** Get register and block descriptors memory backend */
+   Backend &getBackend(void) { return *backend; };
 
-   void halt(void);
-   void reset(void);
-   void run(void);
+   /*
+    * Control methods act on the channel selected by setChannel(); overloads with
+    * explicit channel allow to drive MM2S and S2MM channels concurrently (full-duplex)
+    */
 
-   bool isIdle(void);
-   bool isRunning(void);
-   bool isSG(void);
+   /** Halt selected DMA channel */
+   void halt(void) { halt(channel); };
+   void halt(Channel ch);
+   /** Reset AXI DMA controller */
+   void reset(void) { reset(channel); };
+   void reset(Channel ch);
+   /** Start transfer on selected DMA channel */
+   void run(void) { run(channel); };
+   void run(Channel ch);
 
-   void getStatus(void);
-   bool IRQioc(void);
-   void clearIRQioc(void);
-   
+   /** Get idle status of selected DMA channel */
+   bool isIdle(void) { return isIdle(channel); };
+   bool isIdle(Channel ch);
+   /** Get running state of selected DMA channel */
+   bool isRunning(void) { return isRunning(channel); };
+   bool isRunning(Channel ch);
+   /** Get scatter-gather engine inclusion of selected DMA channel */
+   bool isSG(void) { return isSG(channel); };
+   bool isSG(Channel ch);
+
+   /** Print status of selected DMA channel */
+   void getStatus(void) { getStatus(channel); };
+   void getStatus(Channel ch);
+   /** Get IRQioc status of selected DMA channel */
+   bool IRQioc(void) { return IRQioc(channel); };
+   bool IRQioc(Channel ch);
+   /** Clear IRQioc status of selected DMA channel */
+   void clearIRQioc(void) { clearIRQioc(channel); };
+   void clearIRQioc(Channel ch);
+
+   /* S2MM transfer methods */
    bool rx(uint32_t timeout = 0);
+   bool rx(BlockView &view, uint32_t timeout = 0);
+   bool tryComplete(BlockRange &range);
+   bool tryComplete(BlockView &view);
+   void release(const BlockRange &range);
+   void release(const BlockView &view);
+   void setCyclic(bool enable);
+   /** Set packet mode: S2MM transfers end on a packet boundary (RXEOF), except at ring (segment) end */
+   void setPacketMode(bool enable) { chs[S2MM].packetMode = enable; };
+   /** Get cyclic mode of S2MM scatter-gather ring */
+   bool isCyclic(void) { return chs[S2MM].cyclic; };
+
+   /* MM2S transfer methods */
+   bool tx(uint32_t offset, uint32_t length, uint32_t timeout = 0);
+   bool txFlush(uint32_t timeout = 0);
+
+   int fd(Channel ch = S2MM);
+
+   /** Set wait policy of selected DMA channel */
+   void setWaitPolicy(std::unique_ptr<WaitPolicy> p) { setWaitPolicy(channel, std::move(p)); };
+   void setWaitPolicy(Channel ch, std::unique_ptr<WaitPolicy> p);
+   /** Get wait policy used by rx() (S2MM) or tx() (MM2S) */
+   WaitPolicy &getWaitPolicy(Channel ch = S2MM) { return *chs[ch].policy; };
+
+   /* UIO interrupt methods */
+   /** Open UIO device for interrupt of selected DMA channel */
+   bool openUIO(std::string uioname) { return openUIO(channel, uioname); };
+   bool openUIO(Channel ch, std::string uioname);
+   /** Set interrupt file descriptor of selected DMA channel */
+   void setIrqFd(int fd) { setIrqFd(channel, fd); };
+   void setIrqFd(Channel ch, int fd);
+   /** Close UIO device of selected DMA channel */
+   void closeUIO(void) { closeUIO(channel); };
+   void closeUIO(Channel ch);
+   /** Get true if completion wait is interrupt driven */
+   bool isIrqDriven(Channel ch = S2MM) { return (chs[ch].irqfd >= 0); };
+
+   /** Bind DMA buffer of selected channel (used by BlockView) */
+   void setBuffer(DMABuffer &dbuf) { setBuffer(channel, dbuf); };
+   void setBuffer(Channel ch, DMABuffer &dbuf);
+   void setAutoSync(bool enable);
+   /** Get true if received blocks are synced automatically */
+   bool isAutoSync(void) { return chs[S2MM].autoSync; };
+
+   /** Set address width of AXI DMA core (32 or 64 bit) */
+   void setAddressWidth(uint8_t bits);
+   /** Get address width of AXI DMA core */
+   uint8_t getAddressWidth(void) { return addrWidth; };
 
    /* Direct DMA methods */
-   void initDirect(uint32_t blocksize, uint32_t addr);
+   /** Initialize selected DMA channel in direct mode */
+   void initDirect(uint32_t blocksize, uint64_t addr) { initDirect(channel, blocksize, addr); };
+   void initDirect(Channel ch, uint32_t blocksize, uint64_t addr);
 
    /* Scatter Gather DMA methods */
-   void initSG(uint32_t baseaddr, uint8_t n, uint32_t blocksize, uint32_t tgtaddr);
-   void incSGDescTable(uint8_t index);
+   /** Initialize selected DMA channel in scatter-gather mode */
+   void initSG(uint64_t baseaddr, uint32_t n, uint32_t blocksize, uint64_t tgtaddr) { initSG(channel, baseaddr, n, blocksize, tgtaddr); };
+   void initSG(Channel ch, uint64_t baseaddr, uint32_t n, uint32_t blocksize, uint64_t tgtaddr);
+   /** Initialize selected DMA channel in scatter-gather mode with block descriptors allocated in a DMA buffer */
+   void initSG(DMABuffer &descbuf, uint32_t n, uint32_t blocksize, uint64_t tgtaddr) { initSG(channel, descbuf, n, blocksize, tgtaddr); };
+   void initSG(Channel ch, DMABuffer &descbuf, uint32_t n, uint32_t blocksize, uint64_t tgtaddr);
+   /** Initialize selected DMA channel in scatter-gather mode with a ring spanning several DMA buffers */
+   void initSG(uint64_t baseaddr, uint32_t blocksize, const std::vector<DMABuffer *> &bufs) { initSG(channel, baseaddr, blocksize, bufs); };
+   void initSG(Channel ch, uint64_t baseaddr, uint32_t blocksize, const std::vector<DMABuffer *> &bufs);
+   /** Get number of block descriptors of selected DMA channel ring */
+   uint32_t getSGDescCount(void) { return chs[channel].ndesc; };
+   /** Get buffer size of each block descriptor of selected DMA channel (blocksize of initSG()/initDirect()) */
+   uint32_t getDescBufferSize(void) { return chs[channel].size; };
+   void incSGDescTable(uint32_t index);
    void dumpSGDescTable(void);
    void dumpSGDescAllStatus(void);
    void clearSGDescAllStatus(void);
-   uint32_t getSGDescBufferAddress(uint8_t desc);
+   uint64_t getSGDescBufferAddress(uint32_t desc);
 
    uint32_t getBlockOffset(void);
    uint32_t getBlockSize(void);
+   BlockRange getBlockRange(void);
+   /** Get sequence number of last S2MM transfer (from 0 after reset() or initialization) */
+   uint64_t getBlockSequence(void) { return chs[S2MM].blockSequence; };
+   /** Get completion time of last S2MM transfer */
+   std::chrono::steady_clock::time_point getBlockTime(void) { return chs[S2MM].blockTime; };
+   uint32_t getDescLength(uint32_t desc);
+   const std::vector<Packet> &getPackets(void);
+   BlockView getBlockView(void);
 
 private:
 
-   std::map<std::string, uint8_t> mm2sRegs = { 
-      {"DMACR", 0x00}, 
-      {"DMASR", 0x04},
-      {"START_ADDRESS", 0x18},
-      {"LENGTH", 0x28},
-      {"CURDESC", 0x08},
-      {"TAILDESC", 0x10} };
-
-   std::map<std::string, uint8_t> s2mmRegs = { 
-      {"DMACR", 0x30}, 
-      {"DMASR", 0x34},
-      {"DESTINATION_ADDRESS", 0x48},
-      {"LENGTH", 0x58},
-      {"CURDESC", 0x38},
-      {"TAILDESC", 0x40} };
-
-   std::map<std::string, uint8_t> regs;
-
-   DMACtrl::Channel channel = DMACtrl::Channel::UNKNOWN;
-
-   int dh;
-   volatile uint32_t* mem;      // AXI-DMA controller
-   volatile uint32_t* bdmem;    // block descriptors memory (SG)
-   uint32_t size;
-   uint32_t descaddr;
-   uint32_t targetaddr;
-   uint8_t ndesc;
-   uint32_t blockOffset, blockSize;
-   uint8_t bdStartIndex, bdStopIndex;
-   uint32_t minWait, maxWait, curWait;
-   uint16_t minLoop, maxLoop;
-   uint16_t lastIrqThreshold;
-   bool initsg;
-   bool blockTransfer, bufferTransfer;
+   Channel channel = UNKNOWN;
+
+   std::unique_ptr<Backend> backend;   // AXI-DMA controller registers and descriptors memory
+   ChannelState chs[2];         // MM2S, S2MM
+   std::atomic<bool> pollerStop[2];
+   uint32_t irqWait;            // maximum wait time (us) for interrupt without timeout
+   uint32_t pollerPeriod;       // DMASR poll period (us) of poller thread
+   uint8_t addrWidth = 32;      // address width of AXI DMA core
+
+   /* channel register access (a single volatile load/store with MMIOBackend) */
+   uint32_t getChRegister(Channel ch, Register reg) { return backend->readRegister(channelBase(ch) + reg); }
+   void setChRegister(Channel ch, Register reg, uint32_t value) { backend->writeRegister(channelBase(ch) + reg, value); }
+
+   void setChAddress(Channel ch, Register reg, uint64_t addr);
+   void setDescAddress(volatile uint32_t *mem_address, uint32_t offset, uint64_t addr);
+   uint64_t getDescAddress(volatile uint32_t *mem_address, uint32_t offset);
 
    void setMem(volatile uint32_t *mem_address, uint32_t offset, uint32_t value);
    uint32_t getMem(volatile uint32_t *mem_address, uint32_t offset);
-   void initSGDescriptors(void);
-   void calibrateWaitTime(uint16_t count);
-   uint32_t getBufferAddress(uint8_t desc);
+   uint32_t getDescStatus(volatile uint32_t *mem_address, uint32_t desc);
+   void setDescStatus(volatile uint32_t *mem_address, uint32_t desc, uint32_t value);
+   ChannelState &sgState(const char *func);
+   void initSGRing(Channel ch, uint64_t baseaddr, uint32_t n, uint32_t blocksize, DMABuffer *descbuf = nullptr);
+   void syncDesc(ChannelState &c, uint32_t first, uint32_t count, uint8_t owner);
+   void initSGDescriptors(Channel ch);
+   uint32_t segmentOf(const ChannelState &c, uint32_t desc);
+   DMABuffer *segmentBuffer(const ChannelState &c, uint32_t segment, uint64_t &addr);
+   void syncBlock(ChannelState &c, uint32_t segment, uint32_t offset, uint32_t size, uint8_t owner);
+   void syncPending(ChannelState &c);
+   bool waitCompletion(Channel ch, bool (DMACtrlT::*poll)(void), uint32_t timeout);
+   void idle(Channel ch, uint32_t us);
+   void waitEvent(Channel ch, uint32_t us);
+   void armIRQ(Channel ch);
+   void ackIRQ(Channel ch);
+   void stopPoller(Channel ch);
+   void pollerLoop(Channel ch);
+   uint64_t getBufferAddress(uint32_t desc);
+   void setBlock(ChannelState &c, uint32_t first, uint32_t last, uint32_t offset, uint32_t size, uint32_t bytes);
+   uint32_t scanRing(ChannelState &c, uint32_t max);
+   void takeBlocks(ChannelState &c, uint32_t n);
+   void splitPackets(ChannelState &c);
 
    /* Direct DMA methods */
-   void runDirect(void);
+   void runDirect(Channel ch);
    bool directRx(uint32_t timeout = 0);
+   bool directPoll(void);
 
    /* Scatter Gather DMA methods */
-   void runSG(void);
+   void runSG(Channel ch);
    bool blockRx(uint32_t timeout = 0);
    bool bufferRx(uint32_t timeout = 0);
+   bool blockPoll(void);
+   bool bufferPoll(void);
+   bool txDirectPoll(void);
+   bool txRingPoll(void);
 };
 
+/** AXI DMA controller on registers mapped from /dev/mem */
+using DMACtrl = DMACtrlT<MMIOBackend>;
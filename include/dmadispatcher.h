@@ -0,0 +1,593 @@
+/** @file */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <algorithm>
+#include <utility>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <pthread.h>
+#include <sched.h>
+
+#include "dmactrl.h"
+#include "spscqueue.h"
+#include "waitpolicy.h"
+
+/**
+ * @brief Block (one block descriptor of a S2MM transfer) handed to a dispatcher worker
+ */
+struct DispatchBlock {
+   uint64_t sequence = 0;                             ///< block sequence number (emission order)
+   uint32_t desc = 0;                                 ///< block descriptor index
+   uint32_t segment = 0;                              ///< ring segment (DMA buffer) of data
+   uint32_t offset = 0;                               ///< offset of data from segment start
+   uint32_t bytes = 0;                                ///< transferred bytes
+   std::chrono::steady_clock::time_point timestamp;   ///< completion time of transfer
+};
+
+/**
+ * @brief Statistics of a DMADispatcher
+ */
+struct DispatchStats {
+   uint64_t dispatched = 0;            ///< blocks queued to workers
+   uint64_t emitted = 0;               ///< results emitted in sequence order
+   uint64_t released = 0;              ///< block descriptors given back to the engine (non-cyclic mode)
+   uint64_t steals = 0;                ///< blocks taken from another worker queue
+   uint64_t windowWaits = 0;           ///< acquisition waits on a full reorder window
+   uint64_t timeouts = 0;              ///< rx() calls expired without data
+   std::vector<uint64_t> processed;    ///< blocks processed by each worker
+};
+
+/**
+ * @brief Parallel processing of S2MM blocks with ordered results
+ *
+ * An acquisition thread calls rx() on a configured and running scatter-gather controller
+ * and splits each transfer into blocks (one per block descriptor), dealt round-robin to
+ * N worker threads pinned to CPUs. An idle worker steals from other queues (oldest block
+ * first: it is the one holding back ordered emission). Results go into a reorder window
+ * and are emitted in sequence order; in non-cyclic mode descriptors are released to the
+ * engine as soon as every block up to them is processed.
+ *
+ * Process runs concurrently on workers; Emit calls are serialized, in sequence order, on
+ * whichever worker completes the next block. In cyclic mode blocks are never held back
+ * from the engine: processing must keep up with the ring.
+ *
+ * Member functions are defined in this header since Result is a user type.
+ *
+ * @tparam Backend controller backend (see DMACtrlT)
+ * @tparam Result result of a block (default constructible, move assignable)
+ */
+template<class Backend, typename Result>
+class DMADispatcherT {
+
+public:
+   /** Block processing (worker threads) */
+   using Process = std::function<Result(const DispatchBlock &)>;
+   /** Ordered result delivery (serialized) */
+   using Emit = std::function<void(const DispatchBlock &, Result &)>;
+
+   DMADispatcherT(DMACtrlT<Backend> &dmac, unsigned nworkers, Process process, Emit emit, size_t window = 1024);
+   ~DMADispatcherT(void);
+
+   DMADispatcherT(const DMADispatcherT &) = delete;
+   DMADispatcherT &operator=(const DMADispatcherT &) = delete;
+
+   void setAffinity(const std::vector<int> &cpus);
+   /** Set rx() timeout (us) of acquisition thread: releases and stop requests are handled between rx() calls */
+   void setPollTimeout(uint32_t us) { pollTimeout = us ? us : 1; };
+
+   void start(void);
+   void stop(void);
+   /** Get true if acquisition thread is running */
+   bool isRunning(void) { return running.load(std::memory_order_acquire); };
+
+   DispatchStats getStats(void);
+
+private:
+   // reorder window slot (one per block in flight)
+   struct alignas(CACHE_LINE_SIZE) Slot {
+      DispatchBlock block;
+      Result result;
+      std::atomic<bool> ready{false};
+   };
+
+   // work queue and counters of a worker
+   struct alignas(CACHE_LINE_SIZE) Worker {
+      std::mutex m;
+      std::deque<uint64_t> queue;         // sequence numbers
+      std::atomic<uint64_t> processed{0}, steals{0};
+      std::thread thread;
+   };
+
+   // transfer not yet fully released (acquisition thread)
+   struct Pending {
+      DMACtrlBase::BlockRange range;      // descriptors not yet released
+      uint64_t sequence;                  // sequence number of first descriptor
+   };
+
+   DMACtrlT<Backend> &dmac;
+   Process process;
+   Emit emit;
+   std::unique_ptr<Slot[]> slots;
+   uint64_t mask;
+   std::vector<std::unique_ptr<Worker>> workers;
+   std::vector<int> cpus;
+   uint32_t pollTimeout = 100;
+   bool cyclic = true;
+   uint32_t bufsize = 0;
+
+   std::thread acquisition;
+   std::atomic<bool> stopRequest{false}, running{false}, workersStop{false};
+
+   alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> emitted{0};
+   std::mutex emitMutex;
+
+   alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> queued{0};
+   std::mutex idleMutex;
+   std::condition_variable idleCv;
+
+   // acquisition thread state
+   alignas(CACHE_LINE_SIZE) uint64_t dispatched = 0;
+   std::deque<Pending> pending;
+   std::atomic<uint64_t> released{0}, windowWaits{0}, timeouts{0}, dispatchedCount{0};
+
+   std::mutex errorMutex;
+   std::exception_ptr error;
+
+   void acquire(void);
+   void dispatch(const DMACtrlBase::BlockRange &range, std::chrono::steady_clock::time_point timestamp);
+   void releaseDone(void);
+   void work(unsigned id);
+   bool take(unsigned id, uint64_t &seq);
+   void emitReady(bool wait = false);
+   void fail(std::exception_ptr e);
+   void shutdown(void);
+};
+
+/** Dispatcher on registers mapped from memory device */
+template<typename Result>
+using DMADispatcher = DMADispatcherT<MMIOBackend, Result>;
+
+/**
+ * @brief DMADispatcher constructor
+ *
+ * Workers are pinned to CPUs 0..N-1 (modulo available CPUs) unless setAffinity() is called.
+ *
+ * @param dmac controller with S2MM channel initialized in scatter-gather mode
+ *        (not used by other threads while the dispatcher runs)
+ * @param nworkers number of worker threads
+ * @param process block processing
+ * @param emit ordered result delivery
+ * @param window maximum number of blocks in flight (rounded up to a power of two)
+ *
+ * @throws runtime_error if nworkers or window is zero
+ */
+template<class Backend, typename Result>
+DMADispatcherT<Backend, Result>::DMADispatcherT(DMACtrlT<Backend> &dmac, unsigned nworkers, Process process, Emit emit, size_t window) :
+   dmac(dmac), process(std::move(process)), emit(std::move(emit)) {
+
+   if(nworkers == 0 || window == 0)
+      throw std::runtime_error(std::string(__func__) + ": number of workers and window must be greater than zero");
+
+   size_t n = 1;
+   while(n < window)
+      n <<= 1;
+
+   slots = std::make_unique<Slot[]>(n);
+   mask = n - 1;
+
+   unsigned ncpu = std::max(1u, std::thread::hardware_concurrency());
+   for(unsigned i=0; i<nworkers; i++) {
+      workers.push_back(std::make_unique<Worker>());
+      cpus.push_back(i % ncpu);
+   }
+}
+
+/**
+ * @brief DMADispatcher destructor
+ *
+ * Stop acquisition and worker threads
+ */
+template<class Backend, typename Result>
+DMADispatcherT<Backend, Result>::~DMADispatcherT(void) {
+   shutdown();
+}
+
+/**
+ * @brief Set CPUs of worker threads (before start())
+ *
+ * @param cpus worker i is pinned to cpus[i % cpus.size()] (empty: no pinning)
+ */
+template<class Backend, typename Result>
+void DMADispatcherT<Backend, Result>::setAffinity(const std::vector<int> &cpus) {
+   this->cpus = cpus;
+}
+
+/**
+ * @brief Start acquisition and worker threads
+ *
+ * S2MM channel must be initialized in scatter-gather mode and running (run() called).
+ * Sequence numbers and statistics are cleared.
+ *
+ * @throws runtime_error if dispatcher is already running
+ * @throws runtime_error if S2MM channel is not in scatter-gather mode
+ * @throws runtime_error if S2MM channel is in cyclic mode with automatic cache sync
+ */
+template<class Backend, typename Result>
+void DMADispatcherT<Backend, Result>::start(void) {
+
+   if(acquisition.joinable())
+      throw std::runtime_error(std::string(__func__) + ": dispatcher is already running");
+
+   if(!dmac.isSG(DMACtrlBase::S2MM))
+      throw std::runtime_error(std::string(__func__) + ": DMA channel is not configured for Scatter-Gather mode");
+
+   // next rx() would give blocks back to the device while workers still read them
+   if(dmac.isCyclic() && dmac.isAutoSync())
+      throw std::runtime_error(std::string(__func__) + ": automatic cache sync is not supported in cyclic mode");
+
+   cyclic = dmac.isCyclic();
+   bufsize = dmac.getDescBufferSize();
+
+   for(size_t i=0; i<=mask; i++)
+      slots[i].ready.store(false, std::memory_order_relaxed);
+   emitted = 0;
+   queued = 0;
+   dispatched = 0;
+   pending.clear();
+   released = windowWaits = timeouts = dispatchedCount = 0;
+   error = nullptr;
+   stopRequest = false;
+   workersStop = false;
+
+   for(unsigned i=0; i<workers.size(); i++) {
+
+      Worker &w = *workers[i];
+      w.queue.clear();
+      w.processed = w.steals = 0;
+      w.thread = std::thread(&DMADispatcherT::work, this, i);
+
+      if(!cpus.empty()) {
+         cpu_set_t set;
+         CPU_ZERO(&set);
+         CPU_SET(cpus[i % cpus.size()], &set);
+         // pinning is best effort (CPU may be unavailable in current cpuset)
+         pthread_setaffinity_np(w.thread.native_handle(), sizeof(set), &set);
+      }
+   }
+
+   running.store(true, std::memory_order_release);
+   acquisition = std::thread(&DMADispatcherT::acquire, this);
+}
+
+/**
+ * @brief Stop dispatcher
+ *
+ * Acquisition stops, blocks already dispatched are processed and emitted, then
+ * their descriptors are released.
+ *
+ * @throws exception raised by rx() or by block processing, if any
+ */
+template<class Backend, typename Result>
+void DMADispatcherT<Backend, Result>::stop(void) {
+
+   shutdown();
+
+   if(error)
+      std::rethrow_exception(std::exchange(error, nullptr));
+}
+
+/**
+ * @brief Get dispatcher statistics
+ *
+ * @return statistics since start()
+ */
+template<class Backend, typename Result>
+DispatchStats DMADispatcherT<Backend, Result>::getStats(void) {
+
+   DispatchStats s;
+
+   s.dispatched = dispatchedCount.load(std::memory_order_relaxed);
+   s.emitted = emitted.load(std::memory_order_relaxed);
+   s.released = released.load(std::memory_order_relaxed);
+   s.windowWaits = windowWaits.load(std::memory_order_relaxed);
+   s.timeouts = timeouts.load(std::memory_order_relaxed);
+
+   for(auto &w : workers) {
+      s.steals += w->steals.load(std::memory_order_relaxed);
+      s.processed.push_back(w->processed.load(std::memory_order_relaxed));
+   }
+
+   return s;
+}
+
+/**
+ * @brief Acquisition thread: call rx() and dispatch blocks until stop()
+ */
+template<class Backend, typename Result>
+void DMADispatcherT<Backend, Result>::acquire(void) {
+
+   try {
+
+      while(!stopRequest.load(std::memory_order_relaxed)) {
+
+         releaseDone();
+
+         if(!dmac.rx(pollTimeout)) {
+            timeouts.fetch_add(1, std::memory_order_relaxed);
+            continue;
+         }
+
+         dispatch(dmac.getBlockRange(), dmac.getBlockTime());
+      }
+
+   } catch(...) {
+      fail(std::current_exception());
+   }
+
+   running.store(false, std::memory_order_release);
+}
+
+/**
+ * @brief Split a transfer into blocks and deal them to worker queues
+ *
+ * Waits for free reorder window slots, releasing processed descriptors meanwhile.
+ *
+ * @param range transfer
+ * @param timestamp completion time of transfer
+ */
+template<class Backend, typename Result>
+void DMADispatcherT<Backend, Result>::dispatch(const DMACtrlBase::BlockRange &range, std::chrono::steady_clock::time_point timestamp) {
+
+   if(!cyclic)
+      pending.push_back(Pending{ range, dispatched });
+
+   for(uint32_t desc=range.first; desc<=range.last; desc++) {
+
+      if(dispatched - emitted.load(std::memory_order_acquire) > mask) {
+         windowWaits.fetch_add(1, std::memory_order_relaxed);
+         while(dispatched - emitted.load(std::memory_order_acquire) > mask) {
+            // blocks not dispatched on stop are never emitted: their descriptors stay held
+            if(stopRequest.load(std::memory_order_relaxed))
+               return;
+            releaseDone();
+            std::this_thread::yield();
+         }
+      }
+
+      uint64_t seq = dispatched++;
+      DispatchBlock &b = slots[seq & mask].block;
+      b.sequence = seq;
+      b.desc = desc;
+      b.segment = range.segment;
+      b.offset = range.offset + (desc - range.first) * bufsize;
+      b.bytes = dmac.getDescLength(desc);
+      b.timestamp = timestamp;
+
+      Worker &w = *workers[seq % workers.size()];
+      {
+         std::lock_guard<std::mutex> lock(w.m);
+         w.queue.push_back(seq);
+      }
+      queued.fetch_add(1, std::memory_order_release);
+      dispatchedCount.fetch_add(1, std::memory_order_relaxed);
+   }
+
+   {
+      std::lock_guard<std::mutex> lock(idleMutex);
+   }
+   idleCv.notify_all();
+}
+
+/**
+ * @brief Release descriptors of emitted blocks (non-cyclic mode, in ring order)
+ */
+template<class Backend, typename Result>
+void DMADispatcherT<Backend, Result>::releaseDone(void) {
+
+   uint64_t done = emitted.load(std::memory_order_acquire);
+
+   while(!pending.empty() && pending.front().sequence < done) {
+
+      Pending &p = pending.front();
+      uint32_t count = p.range.last - p.range.first + 1;
+      uint32_t n = (uint32_t) std::min<uint64_t>(count, done - p.sequence);
+
+      DMACtrlBase::BlockRange r = p.range;
+      r.last = r.first + n - 1;
+      dmac.release(r);
+      released.fetch_add(n, std::memory_order_relaxed);
+
+      if(n == count) {
+         pending.pop_front();
+      } else {
+         p.range.first += n;
+         p.range.offset += n * bufsize;
+         p.sequence += n;
+      }
+   }
+}
+
+/**
+ * @brief Worker thread: process blocks from own queue, stealing when empty
+ *
+ * @param id worker index
+ */
+template<class Backend, typename Result>
+void DMADispatcherT<Backend, Result>::work(unsigned id) {
+
+   Worker &w = *workers[id];
+   uint64_t seq;
+   uint32_t nloops = 0;
+
+   while(true) {
+
+      if(take(id, seq)) {
+
+         Slot &s = slots[seq & mask];
+         try {
+            s.result = process(s.block);
+         } catch(...) {
+            s.result = Result();
+            fail(std::current_exception());
+         }
+
+         w.processed.fetch_add(1, std::memory_order_relaxed);
+         // seq_cst: ordered with the emitter reload after unlock (store -> load handoff)
+         s.ready.store(true, std::memory_order_seq_cst);
+         emitReady();
+         nloops = 0;
+         continue;
+      }
+
+      if(workersStop.load(std::memory_order_acquire) && queued.load(std::memory_order_acquire) == 0)
+         break;
+
+      // spin shortly, then sleep until blocks are dispatched
+      if(++nloops < 64) {
+         WaitPolicy::relax();
+         continue;
+      }
+
+      std::unique_lock<std::mutex> lock(idleMutex);
+      idleCv.wait_for(lock, std::chrono::milliseconds(1), [this]() {
+         return queued.load(std::memory_order_acquire) > 0 || workersStop.load(std::memory_order_acquire);
+      });
+      nloops = 0;
+   }
+}
+
+/**
+ * @brief Take next block: oldest of own queue, otherwise oldest of another worker queue
+ *
+ * @param id worker index
+ * @param seq sequence number of block, valid when true is returned
+ *
+ * @return true: block taken
+ * @return false: all queues are empty
+ */
+template<class Backend, typename Result>
+bool DMADispatcherT<Backend, Result>::take(unsigned id, uint64_t &seq) {
+
+   if(queued.load(std::memory_order_acquire) == 0)
+      return false;
+
+   for(size_t k=0; k<workers.size(); k++) {
+
+      Worker &v = *workers[(id + k) % workers.size()];
+      std::lock_guard<std::mutex> lock(v.m);
+
+      if(v.queue.empty())
+         continue;
+
+      seq = v.queue.front();
+      v.queue.pop_front();
+      queued.fetch_sub(1, std::memory_order_relaxed);
+
+      if(k > 0)
+         workers[id]->steals.fetch_add(1, std::memory_order_relaxed);
+
+      return true;
+   }
+
+   return false;
+}
+
+/**
+ * @brief Emit ready results in sequence order
+ *
+ * Only one thread emits at a time; a result made ready while another thread was
+ * emitting is picked up by the check after unlock.
+ *
+ * @param wait true: wait for emit lock (final drain), false: return if another thread emits
+ */
+template<class Backend, typename Result>
+void DMADispatcherT<Backend, Result>::emitReady(bool wait) {
+
+   do {
+
+      std::unique_lock<std::mutex> lock(emitMutex, std::defer_lock);
+      if(wait)
+         lock.lock();
+      else if(!lock.try_lock())
+         return;
+
+      uint64_t e = emitted.load(std::memory_order_relaxed);
+
+      while(slots[e & mask].ready.load(std::memory_order_acquire)) {
+
+         Slot &s = slots[e & mask];
+         try {
+            emit(s.block, s.result);
+         } catch(...) {
+            fail(std::current_exception());
+         }
+
+         s.ready.store(false, std::memory_order_relaxed);
+         emitted.store(++e, std::memory_order_release);
+      }
+
+      lock.unlock();
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+
+   } while(slots[emitted.load(std::memory_order_seq_cst) & mask].ready.load(std::memory_order_seq_cst));
+}
+
+/**
+ * @brief Record first error and stop acquisition
+ *
+ * @param e exception
+ */
+template<class Backend, typename Result>
+void DMADispatcherT<Backend, Result>::fail(std::exception_ptr e) {
+
+   {
+      std::lock_guard<std::mutex> lock(errorMutex);
+      if(!error)
+         error = e;
+   }
+
+   stopRequest = true;
+}
+
+/**
+ * @brief Stop acquisition, drain workers, release emitted blocks
+ */
+template<class Backend, typename Result>
+void DMADispatcherT<Backend, Result>::shutdown(void) {
+
+   stopRequest = true;
+   if(acquisition.joinable())
+      acquisition.join();
+
+   {
+      std::lock_guard<std::mutex> lock(idleMutex);
+      workersStop = true;
+   }
+   idleCv.notify_all();
+
+   for(auto &w : workers)
+      if(w->thread.joinable())
+         w->thread.join();
+
+   // results made ready while another worker was emitting
+   emitReady(true);
+
+   // controller is no longer used by acquisition thread
+   try {
+      releaseDone();
+   } catch(...) {
+      fail(std::current_exception());
+   }
+}
@@ -0,0 +1,111 @@
+/** @file */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <chrono>
+#include <exception>
+
+#include "dmactrl.h"
+#include "spscqueue.h"
+#include "waitpolicy.h"
+
+/**
+ * @brief S2MM transfer published by DMAStream
+ */
+struct StreamBlock {
+   DMACtrlBase::BlockRange range;                     ///< block descriptors and data of transfer
+   uint64_t sequence = 0;                             ///< transfer sequence number
+   std::chrono::steady_clock::time_point timestamp;   ///< completion time (detected by acquisition thread)
+};
+
+/**
+ * @brief Back-pressure statistics of a DMAStream
+ */
+struct StreamStats {
+   uint64_t published = 0;       ///< transfers queued to consumer
+   uint64_t dropped = 0;         ///< transfers dropped on full queue (cyclic mode: data is overwritten anyway)
+   uint64_t fullWaits = 0;       ///< transfers waiting for a free queue slot (non-cyclic mode)
+   uint64_t stallTime = 0;       ///< time (us) acquisition thread waited for free queue slots
+   uint64_t timeouts = 0;        ///< rx() calls expired without data
+   uint64_t releaseWaits = 0;    ///< release() calls waiting for a free release slot
+   size_t highWater = 0;         ///< maximum queue occupancy
+};
+
+/**
+ * @brief S2MM acquisition thread decoupled from data processing
+ *
+ * A dedicated thread calls rx() on a configured and running scatter-gather controller
+ * and publishes each transfer to a consumer thread through a lock-free SPSC queue, so
+ * processing cost never delays polling.
+ * In non-cyclic mode the consumer gives blocks back with release() (in order): ranges
+ * travel back through a second SPSC queue and are released to the engine by the
+ * acquisition thread, the only one touching the controller while the stream runs.
+ * A full queue stalls the acquisition thread (back-pressure reaches the engine through
+ * held descriptors) in non-cyclic mode and drops the transfer in cyclic mode.
+ *
+ * @tparam Backend controller backend (see DMACtrlT)
+ */
+template<class Backend>
+class DMAStreamT {
+
+public:
+   DMAStreamT(DMACtrlT<Backend> &dmac, size_t capacity = 1024);
+   ~DMAStreamT(void);
+
+   DMAStreamT(const DMAStreamT &) = delete;
+   DMAStreamT &operator=(const DMAStreamT &) = delete;
+
+   void start(void);
+   void stop(void);
+   /** Get true if acquisition thread is running */
+   bool isRunning(void) { return running.load(std::memory_order_acquire); };
+
+   bool tryPop(StreamBlock &block);
+   bool pop(StreamBlock &block, uint32_t timeout = 0);
+   void release(const StreamBlock &block);
+
+   void setWaitPolicy(std::unique_ptr<WaitPolicy> p);
+   /** Set rx() timeout (us) of acquisition thread: releases and stop requests are handled between rx() calls */
+   void setPollTimeout(uint32_t us) { pollTimeout = us ? us : 1; };
+
+   StreamStats getStats(void);
+   /** Get number of queued transfers */
+   size_t size(void) { return blocks.size(); };
+   /** Get queue capacity */
+   size_t capacity(void) { return blocks.capacity(); };
+
+private:
+   // counters written by acquisition thread
+   struct alignas(CACHE_LINE_SIZE) ProducerStats {
+      std::atomic<uint64_t> published{0}, dropped{0}, fullWaits{0}, stallTime{0}, timeouts{0}, highWater{0};
+   };
+
+   // counters written by consumer thread
+   struct alignas(CACHE_LINE_SIZE) ConsumerStats {
+      std::atomic<uint64_t> releaseWaits{0};
+   };
+
+   DMACtrlT<Backend> &dmac;
+   SPSCQueue<StreamBlock> blocks;
+   SPSCQueue<DMACtrlBase::BlockRange> releases;
+   std::unique_ptr<WaitPolicy> policy;
+   uint32_t pollTimeout = 100;
+   bool cyclic = true;
+
+   std::thread thread;
+   std::atomic<bool> stopRequest{false}, running{false};
+   std::exception_ptr error;
+
+   ProducerStats pstats;
+   ConsumerStats cstats;
+
+   void acquire(void);
+   void publish(const StreamBlock &block);
+   void drainReleases(void);
+};
+
+using DMAStream = DMAStreamT<MMIOBackend>;
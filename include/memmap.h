@@ -0,0 +1,66 @@
+/** @file */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @brief Owned file descriptor (closed on destruction)
+ */
+class FileHandle {
+
+public:
+   FileHandle(void) {};
+   explicit FileHandle(int fd) : fd(fd) {};
+   ~FileHandle(void) { close(); };
+
+   FileHandle(const FileHandle &) = delete;
+   FileHandle &operator=(const FileHandle &) = delete;
+   FileHandle(FileHandle &&other) noexcept : fd(other.release()) {};
+   FileHandle &operator=(FileHandle &&other) noexcept;
+
+   /** Get file descriptor (-1 if not open) */
+   int get(void) const { return fd; };
+   /** Get true if file descriptor is open */
+   explicit operator bool(void) const { return fd >= 0; };
+   int release(void);
+   void reset(int newfd = -1);
+   void close(void) { reset(); };
+
+private:
+   int fd = -1;
+};
+
+/**
+ * @brief Owned memory mapped area (unmapped on destruction)
+ *
+ * Offset of the mapping does not need to be page aligned: the area is mapped from
+ * the enclosing page and data() points to the requested offset. Offsets are 64 bit
+ * regardless of off_t size of the including code (library uses 64 bit file offsets).
+ */
+class MemMap {
+
+public:
+   MemMap(void) {};
+   ~MemMap(void) { unmap(); };
+
+   MemMap(const MemMap &) = delete;
+   MemMap &operator=(const MemMap &) = delete;
+   MemMap(MemMap &&other) noexcept;
+   MemMap &operator=(MemMap &&other) noexcept;
+
+   bool map(int fd, size_t size, uint64_t offset);
+   void unmap(void);
+
+   /** Get pointer to mapped area at requested offset (nullptr if not mapped) */
+   void *data(void) const { return base ? static_cast<uint8_t *>(base) + shift : nullptr; };
+   /** Get size of mapped area (as requested) */
+   size_t size(void) const { return length - shift; };
+   /** Get true if area is mapped */
+   explicit operator bool(void) const { return base != nullptr; };
+
+private:
+   void *base = nullptr;      // page aligned mapping
+   size_t length = 0;         // length of page aligned mapping
+   size_t shift = 0;          // requested offset - page aligned offset
+};
@@ -0,0 +1,117 @@
+/** @file */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <memory>
+
+#include "dmabackend.h"
+
+/**
+ * @brief Software model of an AXI DMA core
+ *
+ * Registers and a block of "physical" memory (holding block descriptors and data
+ * buffers) are plain memory, so DMACtrl polling, ring and consumer logic can run off-target.
+ * Modelled behaviour:
+ * - DMACR run/stop, reset, cyclic BD enable and IRQThreshold fields
+ * - DMASR Halted, Idle, SGIncld, error, IOC_Irq, Err_Irq and IRQThresholdSts fields
+ * - S2MM channel: a stream source writes data at a configurable rate, walking block descriptors
+ *   (CURDESC to TAILDESC, or endlessly in cyclic mode) or filling the direct mode LENGTH;
+ *   STATUS words report transferred bytes, RXSOF/RXEOF (see setPacketSize()) and Cmplt
+ * - MM2S channel: transfers complete as soon as they are started
+ *
+ * Stream data is a 16 bit little endian counter continuing across transfers, so a consumer
+ * can check that no data has been lost. Completion time of each S2MM block descriptor is
+ * written into its APP0/APP1 fields (as a PL timestamping core would), so completion
+ * latency can be measured (see getCompletionTime()).
+ */
+class SimBackend final : public DMABackend {
+
+public:
+   SimBackend(uint64_t membase, size_t memsize, bool sg = true);
+   SimBackend(uint8_t *memory, uint64_t membase, size_t memsize, bool sg = true);
+   ~SimBackend(void);
+
+   SimBackend(const SimBackend &) = delete;
+   SimBackend &operator=(const SimBackend &) = delete;
+
+   uint32_t readRegister(uint32_t offset) override;
+   void writeRegister(uint32_t offset, uint32_t value) override;
+   volatile uint32_t *mapDescriptors(unsigned ch, uint64_t addr, size_t size) override;
+
+   uint8_t *memory(uint64_t addr, size_t size = 1);
+   /** Get physical address of simulated memory */
+   uint64_t getMemoryBase(void) { return membase; };
+   /** Get size of simulated memory */
+   size_t getMemorySize(void) { return memsize; };
+
+   void setRate(double rate);
+   void setPacketSize(uint32_t size);
+
+   /** Get bytes written by S2MM stream source */
+   uint64_t getBytes(void) { return bytes; };
+   /** Get completed S2MM transfers (block descriptors or direct mode transfers) */
+   uint64_t getTransfers(void) { return transfers; };
+   /** Get S2MM block descriptors overwritten before being consumed (cyclic mode) */
+   uint64_t getOverruns(void) { return overruns; };
+
+   std::chrono::steady_clock::time_point getCompletionTime(void);
+   std::chrono::steady_clock::time_point getCompletionTime(uint64_t bdaddr);
+
+private:
+   /*
+    * State of a channel engine
+    */
+   struct Engine {
+      uint64_t cur = 0;                   // next block descriptor
+      uint64_t tail = 0;                  // TAILDESC
+      uint64_t done = UINT64_MAX;         // last completed block descriptor
+      bool active = false;                // transfer in progress (S2MM)
+      uint32_t threshold = 1, count = 1;  // IRQThreshold, IRQThresholdSts
+      std::chrono::steady_clock::time_point due;
+   };
+
+   static constexpr unsigned NREGS = 0x60 >> 2;
+
+   uint64_t membase;
+   size_t memsize;
+   std::unique_ptr<uint8_t[], void (*)(void *)> mem;
+   std::atomic<uint32_t> regs[NREGS];
+   bool sg;
+   Engine eng[2];                         // MM2S, S2MM
+
+   double rate = 0;                       // S2MM bytes/s (0: unlimited)
+   uint32_t packetSize = 0;               // S2MM packet size (0: one packet per transfer)
+   uint32_t packetLeft = 0;
+   uint64_t streamPos = 0;                // S2MM stream bytes (data pattern position)
+
+   std::atomic<uint64_t> bytes{0}, transfers{0}, overruns{0};
+   std::atomic<int64_t> completion{0};    // completion time (steady_clock ns) of last S2MM transfer
+
+   std::mutex m;
+   std::condition_variable cv;
+   std::thread engine;
+   bool stop = false;
+
+   uint32_t reg(unsigned ch, uint32_t r) { return regs[(ch * 0x30 + r) >> 2].load(std::memory_order_relaxed); };
+   void setReg(unsigned ch, uint32_t r, uint32_t value) { regs[(ch * 0x30 + r) >> 2].store(value, std::memory_order_relaxed); };
+   uint64_t address(unsigned ch, uint32_t r) { return ((uint64_t) reg(ch, r + 4) << 32) | reg(ch, r); };
+   void setStatus(unsigned ch, uint32_t set, uint32_t clear);
+
+   void resetChannels(void);
+   void control(unsigned ch, uint32_t value);
+   void start(unsigned ch);
+   void fail(unsigned ch, uint32_t err);
+   void complete(unsigned ch);
+   void fill(uint8_t *dst, uint32_t size);
+   static int64_t timestamp(void);
+   uint32_t packetBytes(uint32_t size, bool &sof, bool &eof);
+   void txRing(void);
+   void rxStep(void);
+   void engineLoop(void);
+};
@@ -0,0 +1,119 @@
+/** @file */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+/** Cache line size: producer and consumer indexes live on separate lines */
+#define CACHE_LINE_SIZE          64
+
+/**
+ * @brief Bounded lock-free single producer, single consumer queue
+ *
+ * One thread pushes, one thread pops; no locks, no allocation after construction.
+ * Head (consumer) and tail (producer) indexes are padded to separate cache lines,
+ * each side keeps a cached copy of the other side index so that the shared line is
+ * only read when the queue looks full (producer) or empty (consumer).
+ *
+ * @tparam T element type (copied in and out of slots)
+ */
+template<typename T>
+class SPSCQueue {
+
+private:
+   struct alignas(CACHE_LINE_SIZE) Index {
+      std::atomic<uint64_t> value{0};
+      uint64_t cached = 0;                // other side index as last seen by owner
+   };
+
+   std::unique_ptr<T[]> slots;
+   size_t mask;
+   Index head;                            // next slot to pop (consumer)
+   Index tail;                            // next slot to push (producer)
+
+public:
+   /**
+   * @brief SPSCQueue constructor
+   *
+   * @param capacity number of slots (rounded up to a power of two)
+   *
+   * @throws runtime_error if capacity is zero
+   */
+   SPSCQueue(size_t capacity) {
+
+      if(capacity == 0)
+         throw std::runtime_error(std::string(__func__) + ": capacity must be greater than zero");
+
+      size_t n = 1;
+      while(n < capacity)
+         n <<= 1;
+
+      slots = std::make_unique<T[]>(n);
+      mask = n - 1;
+   }
+
+   SPSCQueue(const SPSCQueue &) = delete;
+   SPSCQueue &operator=(const SPSCQueue &) = delete;
+
+   /**
+   * @brief Push an element (producer thread)
+   *
+   * @param item element
+   *
+   * @return true: element queued
+   * @return false: queue is full
+   */
+   bool tryPush(const T &item) {
+
+      uint64_t t = tail.value.load(std::memory_order_relaxed);
+
+      if(t - tail.cached > mask) {
+         tail.cached = head.value.load(std::memory_order_acquire);
+         if(t - tail.cached > mask)
+            return false;
+      }
+
+      slots[t & mask] = item;
+      tail.value.store(t + 1, std::memory_order_release);
+
+      return true;
+   }
+
+   /**
+   * @brief Pop an element (consumer thread)
+   *
+   * @param item element, valid when true is returned
+   *
+   * @return true: element dequeued
+   * @return false: queue is empty
+   */
+   bool tryPop(T &item) {
+
+      uint64_t h = head.value.load(std::memory_order_relaxed);
+
+      if(h == head.cached) {
+         head.cached = tail.value.load(std::memory_order_acquire);
+         if(h == head.cached)
+            return false;
+      }
+
+      item = slots[h & mask];
+      head.value.store(h + 1, std::memory_order_release);
+
+      return true;
+   }
+
+   /** Get number of queued elements (a snapshot when called while the other side runs) */
+   size_t size(void) const {
+      uint64_t h = head.value.load(std::memory_order_acquire);
+      return tail.value.load(std::memory_order_acquire) - h;
+   };
+   /** Get true if queue is empty (snapshot) */
+   bool empty(void) const { return (size() == 0); };
+   /** Get number of slots */
+   size_t capacity(void) const { return mask + 1; };
+};
@@ -0,0 +1,142 @@
+/** @file */
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+
+/**
+ * @brief Wait strategy used by DMACtrl while waiting for DMA transfer completion
+ *
+ * Before each idle step the policy returns the wait time: 0 means busy-poll
+ * (CPU relax instruction), otherwise DMACtrl sleeps (or waits for interrupt) for
+ * the returned time. After each completed transfer the policy gets a feedback
+ * to adapt next wait times.
+ */
+class WaitPolicy {
+
+public:
+   virtual ~WaitPolicy(void) {};
+
+   /**
+   * @brief Get wait time of next idle step
+   *
+   * @param nloops number of idle steps since start of current wait
+   * @param elapsed time (us) since start of current wait
+   * @param timeout timeout value (us) of current wait (0: infinite)
+   *
+   * @return wait time (us), 0: busy-poll
+   */
+   virtual uint32_t next(uint32_t nloops, uint32_t elapsed, uint32_t timeout) = 0;
+
+   /**
+   * @brief Notify a completed transfer
+   *
+   * @param nloops number of idle steps waited
+   * @param elapsed time (us) waited
+   * @param timeout timeout value (us) of the wait (0: infinite)
+   */
+   virtual void completed(uint32_t nloops, uint32_t elapsed, uint32_t timeout) {};
+
+   /**
+   * @brief Get data rate hint
+   *
+   * @return true: low data rate, scatter-gather rx() returns ready blocks without waiting whole buffer
+   * @return false: high data rate
+   */
+   virtual bool lowRate(void) { return false; };
+
+   static void relax(void);
+};
+
+/**
+ * @brief Adaptive sleep: wait time is doubled or halved according to idle steps count
+ *
+ * Default policy: with timeout the minimum wait time is used.
+ */
+class AdaptiveWait : public WaitPolicy {
+
+private:
+   uint32_t minWait, maxWait, curWait;
+   uint16_t minLoop, maxLoop;
+
+public:
+   AdaptiveWait(uint32_t minwait = 100, uint32_t maxwait = 10000, uint16_t minloop = 5, uint16_t maxloop = 10);
+
+   uint32_t next(uint32_t nloops, uint32_t elapsed, uint32_t timeout) override;
+   void completed(uint32_t nloops, uint32_t elapsed, uint32_t timeout) override;
+   bool lowRate(void) override { return (curWait == maxWait); };
+   /** Get current wait time (us) */
+   uint32_t getWaitTime(void) { return curWait; };
+};
+
+/**
+ * @brief Busy-poll: never sleep, relax CPU between polls
+ */
+class BusyPoll : public WaitPolicy {
+
+private:
+   uint32_t yieldLoops;
+
+public:
+   /** @param yieldloops yield CPU to scheduler every yieldloops polls (0: never) */
+   BusyPoll(uint32_t yieldloops = 0) : yieldLoops(yieldloops) {};
+
+   uint32_t next(uint32_t nloops, uint32_t elapsed, uint32_t timeout) override;
+};
+
+/**
+ * @brief Spin then sleep: busy-poll for a time window, then sleep with fixed period
+ */
+class SpinSleep : public WaitPolicy {
+
+private:
+   uint32_t spinTime, sleepTime;
+
+public:
+   /**
+   * @param spintime busy-poll window (us)
+   * @param sleeptime wait time (us) after busy-poll window
+   */
+   SpinSleep(uint32_t spintime = 20, uint32_t sleeptime = 100) : spinTime(spintime), sleepTime(sleeptime) {};
+
+   uint32_t next(uint32_t nloops, uint32_t elapsed, uint32_t timeout) override;
+};
+
+/**
+ * @brief Fixed period sleep
+ */
+class FixedWait : public WaitPolicy {
+
+private:
+   uint32_t period;
+
+public:
+   /** @param period wait time (us) */
+   FixedWait(uint32_t period = 1000) : period(period) {};
+
+   uint32_t next(uint32_t nloops, uint32_t elapsed, uint32_t timeout) override { return period; };
+};
+
+/**
+ * @brief Arrival predictor: sleep until next expected completion, then busy-poll
+ *
+ * Time between completions is estimated with an exponentially weighted moving average.
+ */
+class EWMAWait : public WaitPolicy {
+
+private:
+   double alpha;
+   uint32_t margin, minWait, maxWait;
+   double interval;
+   std::chrono::steady_clock::time_point last;
+   bool started;
+
+public:
+   EWMAWait(double alpha = 0.125, uint32_t margin = 20, uint32_t minwait = 100, uint32_t maxwait = 10000);
+
+   uint32_t next(uint32_t nloops, uint32_t elapsed, uint32_t timeout) override;
+   void completed(uint32_t nloops, uint32_t elapsed, uint32_t timeout) override;
+   bool lowRate(void) override { return (interval >= maxWait); };
+   /** Get estimated time (us) between completions */
+   double getInterval(void) { return interval; };
+};
@@ -0,0 +1,50 @@
+#include <string>
+#include <stdexcept>
+#include <fcntl.h>
+
+#include "dmabackend.h"
+#include "dmactrl.h"
+
+/**
+ * @brief MMIOBackend constructor
+ *
+ * Create a memory mapped area for AXI DMA device
+ *
+ * @param baseaddr AXI DMA base address
+ * @param devname memory device (default /dev/mem); a plain file can stand in for a simulated device
+ *
+ * @throws runtime_error if memory device can not be opened or mapped
+ */
+MMIOBackend::MMIOBackend(uint64_t baseaddr, std::string devname) {
+
+   dh.reset(open(devname.data(), O_RDWR | O_SYNC | O_CLOEXEC));
+   if(!dh)
+      throw std::runtime_error(std::string(__func__) + ": can not open " + devname);
+
+   if(!regmap.map(dh.get(), AXI_DMA_DEPTH, baseaddr))
+      throw std::runtime_error(std::string(__func__) + ": can not map AXI DMA registers from " + devname);
+
+   mem = (volatile uint32_t *) regmap.data();
+}
+
+/**
+ * @brief Map block descriptors memory of a channel from memory device
+ *
+ * Mapping is reused if the ring is initialized again on the same descriptors memory.
+ *
+ * @param ch channel index (0: MM2S, 1: S2MM)
+ * @param addr physical address of block descriptors
+ * @param size size of block descriptors area
+ *
+ * @return pointer to block descriptors (nullptr: map failure)
+ */
+volatile uint32_t *MMIOBackend::mapDescriptors(unsigned ch, uint64_t addr, size_t size) {
+
+   if(!bdmap[ch] || bdaddr[ch] != addr || bdmap[ch].size() < size) {
+      if(!bdmap[ch].map(dh.get(), size, addr))
+         return nullptr;
+      bdaddr[ch] = addr;
+   }
+
+   return (volatile uint32_t *) bdmap[ch].data();
+}
@@ -5,23 +5,113 @@
 #include <cstdint>
 #include <filesystem>
 #include <fstream>
+#include <cstdio>      // snprintf
+#include <cerrno>
 #include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <cstring>
+#include <utility>
+#include <algorithm>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 #include "dmabuffer.h"
 
+// u-dma-buf ioctl interface (u-dma-buf.h, v4.0 and later)
+#define U_DMA_BUF_IOCTL_MAGIC                'U'
+#define U_DMA_BUF_IOCTL_SET_SYNC_FOR_CPU     _IOW(U_DMA_BUF_IOCTL_MAGIC, 5, uint64_t)
+#define U_DMA_BUF_IOCTL_SET_SYNC_FOR_DEVICE  _IOW(U_DMA_BUF_IOCTL_MAGIC, 6, uint64_t)
+
+// sync command: offset[63:32], size[31:4], direction[3:2], area enable[0]
+#define U_DMA_BUF_SYNC_COMMAND(offset, size, direction) \
+   ( ((uint64_t) (offset) << 32) | ((uint64_t) (size) & 0xFFFFFFF0) | (((uint64_t) (direction) & 0x3) << 2) | 1 )
+
 /**
  * @brief DMABuffer constructor
  */
 DMABuffer::DMABuffer(void) {
-   fd = -1;
+   buf = nullptr;
+   buf_size = 0;
+   phys_addr = 0;
+   sync_mode = 1;
+   cache_on = false;
+   sync_method = SYNC_AUTO;
+   setDeviceDirs("/dev");
 }
 
 /**
  * @brief DMABuffer destructor
  */
 DMABuffer::~DMABuffer(void) {
-   if(fd != -1)
-      close();
+   close();
+}
+
+/**
+ * @brief DMABuffer move constructor
+ *
+ * @param other buffer to move from (left closed)
+ *
+ * @note DMACtrl keeps pointers to bound buffers (setBuffer(), multi-buffer ring):
+ * buffers must not be moved while bound
+ */
+DMABuffer::DMABuffer(DMABuffer &&other) noexcept : DMABuffer() {
+   *this = std::move(other);
+}
+
+/**
+ * @brief Take ownership of another udmabuf, closing the current one
+ *
+ * @param other buffer to move from (left closed)
+ * @return this buffer
+ */
+DMABuffer &DMABuffer::operator=(DMABuffer &&other) noexcept {
+
+   if(this == &other)
+      return *this;
+
+   close();
+
+   name = std::move(other.name);
+   sys_class_path = std::move(other.sys_class_path);
+   dev_dir = other.dev_dir;
+   sys_class_dirs = other.sys_class_dirs;
+   fd = std::move(other.fd);
+   bufmap = std::move(other.bufmap);
+   buf = std::exchange(other.buf, nullptr);
+   buf_size = std::exchange(other.buf_size, 0);
+   phys_addr = std::exchange(other.phys_addr, 0);
+   sync_mode = other.sync_mode;
+   cache_on = other.cache_on;
+   sync_method = other.sync_method;
+   for(int i=0; i<SYNC_NATTR; i++)
+      sync_fd[i] = std::move(other.sync_fd[i]);
+   for(int i=0; i<=SYNC_DIRECTION; i++)
+      sync_value[i] = other.sync_value[i];
+
+   return *this;
+}
+
+/**
+ * @brief Set directories of udmabuf device node and sysfs class (used by next open())
+ *
+ * A fake udmabuf (plain files) can stand in for the driver, e.g. in tests.
+ *
+ * @param devdir device node directory (default /dev)
+ * @param sysclassdir sysfs class directory holding <bufname> attributes
+ *        (empty: /sys/class/u-dma-buf, then /sys/class/udmabuf)
+ */
+void DMABuffer::setDeviceDirs(std::string devdir, std::string sysclassdir) {
+
+   dev_dir = devdir;
+
+   if(sysclassdir.empty())
+      sys_class_dirs = {"/sys/class/u-dma-buf", "/sys/class/udmabuf"};
+   else
+      sys_class_dirs = { sysclassdir };
 }
 
 /**
@@ -30,21 +120,22 @@ DMABuffer::~DMABuffer(void) {
  * @param bufname filename (e.g. udmabuf0)
  * @param cache_on 
  * @parblock
- * - true: disable CPU cache on the DMA buffer allocated by udmabuf (O_SYNC flag not used)
- * - false: enable CPU cache on the DMA buffer allocated by udmabuf (O_SYNC flag used)
+ * - true: enable CPU cache on the DMA buffer allocated by udmabuf (O_SYNC flag not used)
+ * - false: disable CPU cache on the DMA buffer allocated by udmabuf (O_SYNC flag used)
  * @endparblock
  *
  * @note O_SYNC 
+ * @note an already open udmabuf is closed first, so a buffer can be reopened on each run
  *
  * @return true: open success
  * @return false: open failure
  */
 bool DMABuffer::open(std::string bufname, bool cache_on) {
 
-   std::vector<std::string> sys_class_path_list = {"/sys/class/u-dma-buf", "/sys/class/udmabuf"};
+   close();
 
    bool found = false;
-   for (auto& dir : sys_class_path_list) {
+   for (auto& dir : sys_class_dirs) {
 
       std::string subdir = std::string(dir) + "/" + std::string(bufname);
       std::filesystem::directory_entry entry(subdir.data());
@@ -71,7 +162,7 @@ bool DMABuffer::open(std::string bufname, bool cache_on) {
       return false;
    }
    std::getline(f, line);
-   phys_addr = std::stoul(line, nullptr, 16);
+   phys_addr = std::stoull(line, nullptr, 16);
    f.close();
 
    filename = sys_class_path + "/size";
@@ -84,14 +175,31 @@ bool DMABuffer::open(std::string bufname, bool cache_on) {
    buf_size = std::stoul(line);
    f.close();
 
-   filename = "/dev/" + name;
-   if((fd = ::open(filename.data(), O_RDWR | ((cache_on == 0)? O_SYNC : 0))) == -1) {
+   filename = dev_dir + "/" + name;
+   FileHandle h(::open(filename.data(), O_RDWR | O_CLOEXEC | ((cache_on == 0)? O_SYNC : 0)));
+   if(!h) {
       std::cout << "E: can not open " << filename << std::endl;
       return false;
    }
 
-   buf = (uint8_t *) mmap(NULL, buf_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+   if(!bufmap.map(h.get(), buf_size, 0)) {
+      std::cout << "E: can not map " << filename << std::endl;
+      return false;
+   }
+
+   fd = std::move(h);
+   buf = (uint8_t *) bufmap.data();
    sync_mode = 1;
+   this->cache_on = cache_on;
+
+   // missing attributes are reported when used
+   const char *attrs[SYNC_NATTR] = { "sync_offset", "sync_size", "sync_direction", "sync_for_cpu", "sync_for_device", "sync_mode" };
+   for(int i=0; i<SYNC_NATTR; i++) {
+      filename = sys_class_path + "/" + attrs[i];
+      sync_fd[i].reset(::open(filename.data(), O_WRONLY | O_CLOEXEC));
+   }
+   for(int i=0; i<=SYNC_DIRECTION; i++)
+      sync_value[i] = UINT64_MAX;
 
    return true;
 }
@@ -99,64 +207,80 @@ bool DMABuffer::open(std::string bufname, bool cache_on) {
 /**
  * @brief Close udmabuf
  *
+ * Buffer is unmapped and all file descriptors (device, sysfs sync attributes) are closed.
+ *
  * @return true: close success
  * @return false: close failure
  */
 bool DMABuffer::close(void) {
 
-   if(fd < 0)
+   if(!fd)
       return false;
 
-   ::close(fd);
-   fd = -1;
+   bufmap.unmap();
+   buf = nullptr;
+   fd.close();
+
+   for(int i=0; i<SYNC_NATTR; i++)
+      sync_fd[i].close();
+
    return true;
 }
 
 /**
- * @brief Set a sync area when CPU cache is manually managed
+ * @brief Write a value to a sysfs sync attribute
  *
- * @param offset area address
- * @param size area size
- * @param direction 1: DMA_TO_DEVICE (for PS->PL transfer), 2: DMA_FROM_DEVICE owner (for PL->PS transfer)
+ * Offset, size and direction are written only when changed.
  *
- * @return true: set sync area success
- * @return false: set sync area failure
+ * @param attr sync attribute
+ * @param value value
+ *
+ * @return true: write success
+ * @return false: write failure
  */
-bool DMABuffer::setSyncArea(uint32_t offset, uint32_t size, uint8_t direction) {
+bool DMABuffer::writeAttr(SyncAttr attr, uint64_t value) {
 
-   std::string filename;
-   std::fstream f;
+   if(attr <= SYNC_DIRECTION && sync_value[attr] == value)
+      return true;
 
-   filename = sys_class_path + "/sync_offset";
-   f.open(filename, std::fstream::out);
-   if(!f.is_open()) {
-      std::cout << "E: can not open " << filename << std::endl;
+   if(!sync_fd[attr]) {
+      std::cout << "E: sync attribute " << attr << " of " << name << " is not open" << std::endl;
       return false;
    }
-   f << offset;
-   f.close();
 
-   filename = sys_class_path + "/sync_size";
-   f.open(filename, std::fstream::out);
-   if(!f.is_open()) {
-      std::cout << "E: can not open " << filename << std::endl;
-      return false;
-   }
-   f << size;
-   f.close();
+   char str[24];
+   int len = snprintf(str, sizeof(str), "%llu", (unsigned long long) value);
 
-   filename = sys_class_path + "/sync_direction";
-   f.open(filename, std::fstream::out);
-   if(!f.is_open()) {
-      std::cout << "E: can not open " << filename << std::endl;
+   if(pwrite(sync_fd[attr].get(), str, len, 0) != len) {
+      std::cout << "E: can not write sync attribute " << attr << " of " << name << std::endl;
+      if(attr <= SYNC_DIRECTION)
+         sync_value[attr] = UINT64_MAX;
       return false;
    }
-   f << direction;
-   f.close();
+
+   if(attr <= SYNC_DIRECTION)
+      sync_value[attr] = value;
 
    return true;
 }
 
+/**
+ * @brief Set a sync area when CPU cache is manually managed
+ *
+ * @param offset area address
+ * @param size area size
+ * @param direction 1: DMA_TO_DEVICE (for PS->PL transfer), 2: DMA_FROM_DEVICE owner (for PL->PS transfer)
+ *
+ * @return true: set sync area success
+ * @return false: set sync area failure
+ */
+bool DMABuffer::setSyncArea(uint32_t offset, uint32_t size, uint8_t direction) {
+
+   return( writeAttr(SYNC_OFFSET, offset) &&
+      writeAttr(SYNC_SIZE, size) &&
+      writeAttr(SYNC_DIRECTION, direction) );
+}
+
 /**
  * @brief Set a buffer owner (CPU or DEVICE) when CPU cache is manually managed
  *
@@ -167,27 +291,101 @@ bool DMABuffer::setSyncArea(uint32_t offset, uint32_t size, uint8_t direction) {
  */
 bool DMABuffer::setBufferOwner(uint8_t owner) {
 
-   std::string filename;
-   std::fstream f;
-
    if(owner == CPU_OWNER) {
-      filename = sys_class_path + "/sync_for_cpu";
+      return writeAttr(SYNC_FOR_CPU, 1);
    } else if(owner == DEVICE_OWNER) {
-      filename = sys_class_path + "/sync_for_device";
-   } else {
-      std::cout << "E: owner not valid" << std::endl;
-      return false;
+      return writeAttr(SYNC_FOR_DEVICE, 1);
    }
 
-   f.open(filename, std::fstream::out);
-   if(!f.is_open()) {
-      std::cout << "E: can not open " << filename << std::endl;
+   std::cout << "E: owner not valid" << std::endl;
+   return false;
+}
+
+/**
+ * @brief Give an area of the buffer to CPU after a PL->PS transfer
+ *
+ * CPU cache lines of the area are invalidated (no action if CPU cache is disabled).
+ *
+ * @param offset area offset
+ * @param size area size
+ * @param direction direction of DMA transfers on the area (default DMA_FROM_DEVICE)
+ *
+ * @return true: sync success
+ * @return false: sync failure
+ */
+bool DMABuffer::syncForCpu(uint32_t offset, uint32_t size, uint8_t direction) {
+
+   if(!cache_on)
+      return true;
+
+   return sync(CPU_OWNER, offset, size, direction);
+}
+
+/**
+ * @brief Give an area of the buffer to DMA device
+ *
+ * With DMA_TO_DEVICE (after CPU writes) CPU cache lines of the area are written back;
+ * with DMA_FROM_DEVICE (area to be filled again by PL) they are dropped as well
+ * (no action if CPU cache is disabled).
+ *
+ * @param offset area offset
+ * @param size area size
+ * @param direction direction of DMA transfers on the area (default DMA_TO_DEVICE)
+ *
+ * @return true: sync success
+ * @return false: sync failure
+ */
+bool DMABuffer::syncForDevice(uint32_t offset, uint32_t size, uint8_t direction) {
+
+   if(!cache_on)
+      return true;
+
+   return sync(DEVICE_OWNER, offset, size, direction);
+}
+
+/**
+ * @brief Sync an area of the buffer through ioctl or sysfs interface
+ *
+ * With SYNC_AUTO the ioctl interface is tried first: if the driver does not support it
+ * (ENOTTY) sysfs interface is selected for all following calls.
+ *
+ * @param owner CPU_OWNER or DEVICE_OWNER
+ * @param offset area offset
+ * @param size area size (rounded up to 16 bytes for ioctl interface, up to buffer end at most)
+ * @param direction DMA_TO_DEVICE, DMA_FROM_DEVICE or DMA_BIDIRECTIONAL
+ *
+ * @return true: sync success
+ * @return false: sync failure
+ */
+bool DMABuffer::sync(uint8_t owner, uint32_t offset, uint32_t size, uint8_t direction) {
+
+   if((uint64_t) offset + size > buf_size) {
+      std::cout << "E: sync area is outside of " << name << std::endl;
       return false;
    }
-   f << 1;
-   f.close();
 
-   return true;
+   if(sync_method != SYNC_SYSFS) {
+
+      // driver rejects (EINVAL) an area ending past the buffer
+      uint64_t end = std::min<uint64_t>((uint64_t) offset + size + 15, buf_size);
+      uint64_t cmd = U_DMA_BUF_SYNC_COMMAND(offset, end - offset, direction);
+      unsigned long req = (owner == CPU_OWNER) ? U_DMA_BUF_IOCTL_SET_SYNC_FOR_CPU : U_DMA_BUF_IOCTL_SET_SYNC_FOR_DEVICE;
+
+      if(ioctl(fd.get(), req, &cmd) == 0) {
+         sync_method = SYNC_IOCTL;
+         return true;
+      }
+
+      if(sync_method == SYNC_IOCTL || errno != ENOTTY) {
+         std::cout << "E: sync ioctl failed on " << name << " (errno " << errno << ")" << std::endl;
+         return false;
+      }
+
+      // driver without ioctl interface
+      sync_method = SYNC_SYSFS;
+   }
+
+   return( setSyncArea(offset, size, direction) && setBufferOwner(owner) );
 }
 
 /**
@@ -211,20 +409,138 @@ bool DMABuffer::setBufferOwner(uint8_t owner) {
  * @return false: set sync mode failure
  */
 bool DMABuffer::setSyncMode(uint8_t mode) {
-   std::string filename;
-   std::fstream f;
 
-   if(mode < 0 || mode > 7)
+   if(mode > 7)
       return false;
 
-   filename = sys_class_path + "/sync_mode";
-   f.open(filename, std::fstream::out);
-   if(!f.is_open()) {
-      std::cout << "E: can not open " << filename << std::endl;
+   if(!writeAttr(SYNC_MODE, mode))
+      return false;
+
+   sync_mode = mode;
+   return true;
+}
+
+/**
+ * @brief Copy an area of the buffer to cached memory
+ *
+ * Wide loads are used (see streamCopy()), so that blocks of an uncached buffer
+ * (opened with cache_on false) are staged into cached memory at close to bus bandwidth.
+ *
+ * @param offset offset of data in buffer
+ * @param size size of data
+ * @param dst destination
+ *
+ * @return true: copy success
+ * @return false: area is outside of buffer
+ */
+bool DMABuffer::copyOut(uint32_t offset, uint32_t size, void *dst) {
+
+   if(!fd || (uint64_t) offset + size > buf_size) {
+      std::cout << "E: copy area is outside of " << name << std::endl;
       return false;
    }
-   f << mode;
-   f.close();
 
+   streamCopy(dst, buf + offset, size);
    return true;
 }
+
+/**
+ * @brief Copy several areas of the buffer to cached memory (scatter copy)
+ *
+ * @param regions areas of buffer and related destinations
+ *
+ * @return true: copy success
+ * @return false: an area is outside of buffer (no area is copied)
+ */
+bool DMABuffer::copyOut(const std::vector<CopyRegion> &regions) {
+
+   for(const CopyRegion &r : regions) {
+      if(!fd || (uint64_t) r.offset + r.size > buf_size) {
+         std::cout << "E: copy area is outside of " << name << std::endl;
+         return false;
+      }
+   }
+
+   for(const CopyRegion &r : regions)
+      streamCopy(r.dst, buf + r.offset, r.size);
+
+   return true;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/*
+ * SSE4.1 streaming loads (MOVNTDQA) of 64 bytes per step; src is 16 byte aligned
+ */
+__attribute__((target("sse4.1")))
+static size_t streamCopySSE41(uint8_t *dst, const uint8_t *src, size_t size) {
+
+   size_t n = size & ~(size_t) 63;
+
+   for(size_t i=0; i<n; i+=64) {
+      __m128i *s = (__m128i *) (src + i);
+      __m128i a = _mm_stream_load_si128(s);
+      __m128i b = _mm_stream_load_si128(s + 1);
+      __m128i c = _mm_stream_load_si128(s + 2);
+      __m128i d = _mm_stream_load_si128(s + 3);
+      _mm_storeu_si128((__m128i *) (dst + i), a);
+      _mm_storeu_si128((__m128i *) (dst + i + 16), b);
+      _mm_storeu_si128((__m128i *) (dst + i + 32), c);
+      _mm_storeu_si128((__m128i *) (dst + i + 48), d);
+   }
+
+   return n;
+}
+#endif
+
+/**
+ * @brief Copy from DMA (device or uncached) memory to cached memory
+ *
+ * Source is read with aligned wide loads only: 4x128 bit NEON loads on ARM, SSE4.1
+ * streaming loads on x86 (if supported by CPU), 64 bit loads otherwise. Unaligned
+ * head and tail are copied byte by byte, so no access crosses the source area.
+ *
+ * @param dst destination
+ * @param src source (DMA buffer memory)
+ * @param size size of data
+ */
+void DMABuffer::streamCopy(void *dst, const void *src, size_t size) {
+
+   uint8_t *d = (uint8_t *) dst;
+   const volatile uint8_t *s = (const volatile uint8_t *) src;
+
+   // align source to 16 bytes
+   while(size > 0 && ((uintptr_t) s & 15)) {
+      *d++ = *s++;
+      size--;
+   }
+
+   size_t done = 0;
+
+#if defined(__ARM_NEON)
+   const uint8_t *p = (const uint8_t *) s;
+   for(; done + 64 <= size; done += 64) {
+      uint8x16_t a = vld1q_u8(p + done);
+      uint8x16_t b = vld1q_u8(p + done + 16);
+      uint8x16_t c = vld1q_u8(p + done + 32);
+      uint8x16_t e = vld1q_u8(p + done + 48);
+      vst1q_u8(d + done, a);
+      vst1q_u8(d + done + 16, b);
+      vst1q_u8(d + done + 32, c);
+      vst1q_u8(d + done + 48, e);
+   }
+#elif defined(__x86_64__) || defined(__i386__)
+   static const bool sse41 = __builtin_cpu_supports("sse4.1");
+   if(sse41)
+      done = streamCopySSE41(d, (const uint8_t *) s, size);
+#endif
+
+   // 64 bit loads
+   const volatile uint64_t *s64 = (const volatile uint64_t *) (s + done);
+   for(; done + 8 <= size; done += 8) {
+      uint64_t w = *s64++;
+      std::memcpy(d + done, &w, 8);
+   }
+
+   for(; done < size; done++)
+      d[done] = s[done];
+}
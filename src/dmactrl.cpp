@@ -2,67 +2,119 @@
 #include <iomanip>
 #include <string>
 #include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
 #include <fcntl.h>
 #include <unistd.h>  // usleep
 #include <stdexcept>
-#include <sys/mman.h>
+#include <utility>
+#include <poll.h>
+#include <sys/eventfd.h>
 
 #include "dmactrl.h"
+#include "dmabuffer.h"
+#include "simbackend.h"
 
 //#define DEBUG
 
 /**
- * @brief DMACtrl constructor
+ * @brief DMACtrl constructor with register and block descriptors memory backend
  *
- * Create a memory mapped area for AXI DMA device
+ * @param backend backend (e.g. SimBackend for a software model of AXI DMA)
  *
- * @param baseaddr AXI DMA base address
+ * @throws runtime_error if backend is null
  */
-DMACtrl::DMACtrl(uint32_t baseaddr) {
+template<class Backend>
+DMACtrlT<Backend>::DMACtrlT(std::unique_ptr<Backend> backend) : backend(std::move(backend)) {
 
-   dh = open("/dev/mem", O_RDWR | O_SYNC);
-   // check return value
+   if(!this->backend)
+      throw std::runtime_error(std::string(__func__) + ": backend is null");
 
-   mem = (uint32_t *) mmap(NULL, AXI_DMA_DEPTH, PROT_READ | PROT_WRITE, MAP_SHARED, dh, baseaddr);
-   // check return value
+   for(auto ch : { MM2S, S2MM }) {
+      chs[ch].policy = std::make_unique<AdaptiveWait>();
+      pollerStop[ch] = false;
+   }
+
+   irqWait = 10000;        // 10 ms
+   pollerPeriod = 100;     // 100 us
+}
+
+/**
+ * @brief DMACtrl destructor
+ *
+ * Stop poller threads, close UIO devices; backend releases memory mapped areas
+ * (AXI DMA device, block descriptors)
+ *
+ */
+template<class Backend>
+DMACtrlT<Backend>::~DMACtrlT(void) {
 
-   minLoop = 5;
-   maxLoop = 10;
+   for(auto ch : { MM2S, S2MM }) {
+      stopPoller(ch);
+      closeUIO(ch);
+   }
+}
 
-   minWait = 100;    // 100 us
-   maxWait = 10000;  //  10 ms
-   curWait = (maxWait - minWait) / 2;
+/**
+ * @brief DMACtrl move constructor
+ *
+ * @param other controller to move from (can only be destroyed or assigned afterwards)
+ *
+ * @note poller threads of other are stopped: fd() must be called again to get a pollable descriptor
+ */
+template<class Backend>
+DMACtrlT<Backend>::DMACtrlT(DMACtrlT &&other) noexcept : irqWait(0), pollerPeriod(0) {
 
-   bdStartIndex = 0;
-   bdStopIndex = 0;
+   for(auto ch : { MM2S, S2MM })
+      pollerStop[ch] = false;
 
-   initsg = false;
-   blockTransfer = false;
-   bufferTransfer = false;
+   *this = std::move(other);
 }
 
 /**
- * @brief DMACtrl destructor
+ * @brief Take ownership of another controller, releasing resources of the current one
  *
- * Unmap memory mapped area for AXI DMA device
+ * @param other controller to move from (can only be destroyed or assigned afterwards)
+ * @return this controller
  *
+ * @note poller threads of other are stopped: fd() must be called again to get a pollable descriptor
  */
-DMACtrl::~DMACtrl(void) {
-   munmap((uint32_t *) mem, AXI_DMA_DEPTH);
+template<class Backend>
+DMACtrlT<Backend> &DMACtrlT<Backend>::operator=(DMACtrlT &&other) noexcept {
+
+   if(this == &other)
+      return *this;
+
+   for(auto ch : { MM2S, S2MM }) {
+      stopPoller(ch);
+      closeUIO(ch);
+      // poller thread refers to other
+      other.stopPoller(ch);
+      chs[ch] = std::move(other.chs[ch]);
+      other.chs[ch] = ChannelState{};
+   }
+
+   channel = other.channel;
+   backend = std::move(other.backend);
+   irqWait = other.irqWait;
+   pollerPeriod = other.pollerPeriod;
+   addrWidth = other.addrWidth;
+
+   return *this;
 }
 
 /**
  * @brief Set transfer channel
  *
+ * Select channel of control methods without explicit channel argument
+ *
  * @param ch channel
  */
-void DMACtrl::setChannel(DMACtrl::Channel ch) {
-
+template<class Backend>
+void DMACtrlT<Backend>::setChannel(Channel ch) {
    channel = ch;
-   if(channel == MM2S)
-      regs = mm2sRegs;
-   else if(channel == S2MM)
-      regs = s2mmRegs;
 }
 
 /**
@@ -71,8 +123,9 @@ void DMACtrl::setChannel(DMACtrl::Channel ch) {
  * @param offset address
  * @param value value
  */
-void DMACtrl::setRegister(uint8_t offset, uint32_t value) {
-   mem[offset>>2] = value;
+template<class Backend>
+void DMACtrlT<Backend>::setRegister(uint8_t offset, uint32_t value) {
+   backend->writeRegister(offset, value);
 }
 
 /**
@@ -80,35 +133,47 @@ void DMACtrl::setRegister(uint8_t offset, uint32_t value) {
  *
  * @param offset address
  */
-uint32_t DMACtrl::getRegister(uint8_t offset) {
-   return (mem[offset>>2]);
+template<class Backend>
+uint32_t DMACtrlT<Backend>::getRegister(uint8_t offset) {
+   return backend->readRegister(offset);
 }
 
 /**
- * @brief Halt AXI DMA controller
+ * @brief Halt AXI DMA channel
+ *
+ * @param ch channel
  *
  * @throws runtime_error if DMA channel is not set
  *
  */
-void DMACtrl::halt(void) {
+template<class Backend>
+void DMACtrlT<Backend>::halt(Channel ch) {
 
-   if(channel == UNKNOWN)
+   if(ch == UNKNOWN)
       throw std::runtime_error(std::string(__func__) + ": DMA channel is not set");
 
-   setRegister(regs["DMACR"], 0);
+   setChRegister(ch, DMACR, 0);
 }
 
 /**
  * @brief Reset AXI DMA controller
  *
+ * @param ch channel
+ *
  * @throws runtime_error if DMA channel is not set
+ *
+ * @note soft reset affects both MM2S and S2MM channels
  */
-void DMACtrl::reset(void) {
+template<class Backend>
+void DMACtrlT<Backend>::reset(Channel ch) {
 
-   if(channel == UNKNOWN)
+   if(ch == UNKNOWN)
       throw std::runtime_error(std::string(__func__) + ": DMA channel is not set");
 
-   setRegister(regs["DMACR"], 4);
+   // soft reset affects both channels
+   chs[MM2S].sequence = chs[S2MM].sequence = 0;
+
+   setChRegister(ch, DMACR, 4);
 }
 
 /**
@@ -116,16 +181,23 @@ void DMACtrl::reset(void) {
  *
  * - in scatter-gather mode start DMA controller and set TAILDESC register
  * - in direct mode start DMA controller and set LENGTH register
+ *
+ * @param ch channel
  */
-void DMACtrl::run(void) {
+template<class Backend>
+void DMACtrlT<Backend>::run(Channel ch) {
+
+   armIRQ(ch);
 
-   if(isSG()) runSG();
-   else runDirect();
+   if(isSG(ch)) runSG(ch);
+   else runDirect(ch);
 }
 
 /**
  * @brief Get idle status of DMA channel (DMASR register)
  *
+ * @param ch channel
+ *
  * @return true: DMA is idle
  * @return false: DMA is not idle
  *
@@ -133,44 +205,51 @@ void DMACtrl::run(void) {
  *
  * @note After a successful DMA transfer idle flag reports end of transfer
  */
-bool DMACtrl::isIdle(void) {
+template<class Backend>
+bool DMACtrlT<Backend>::isIdle(Channel ch) {
 
-   if(channel == UNKNOWN)
+   if(ch == UNKNOWN)
       throw std::runtime_error(std::string(__func__) + ": DMA channel is not set");
 
-   return( getRegister(regs["DMASR"]) & 0x0002 );
+   return( getChRegister(ch, DMASR) & 0x0002 );
 }
 
 /**
  * @brief Get running state of DMA channel (DMASR register)
  *
+ * @param ch channel
+ *
  * @return true: DMA is running
  * @return false: DMA is not running
  *
  * @throws runtime_error if DMA channel is not set
  */
-bool DMACtrl::isRunning(void) {
+template<class Backend>
+bool DMACtrlT<Backend>::isRunning(Channel ch) {
 
-   if(channel == UNKNOWN)
+   if(ch == UNKNOWN)
       throw std::runtime_error(std::string(__func__) + ": DMA channel is not set");
 
-   return( ~(getRegister(regs["DMASR"]) & 0x0001) );
+   return( ~(getChRegister(ch, DMASR) & 0x0001) );
 }
 
 /**
  * @brief Get scatter-gather engine included for DMA channel (DMASR register)
  *
+ * @param ch channel
+ *
  * @return true: scatter-gather engine is included
  * @return false: scatter-gather engine is not included (direct mode)
  *
  * @throws runtime_error if DMA channel is not set
  */
-bool DMACtrl::isSG(void) {
+template<class Backend>
+bool DMACtrlT<Backend>::isSG(Channel ch) {
 
-   if(channel == UNKNOWN)
+   if(ch == UNKNOWN)
       throw std::runtime_error(std::string(__func__) + ": DMA channel is not set");
 
-   return( getRegister(regs["DMASR"]) & 0x0008 );
+   return( getChRegister(ch, DMASR) & 0x0008 );
 }
 
 /**
@@ -180,7 +259,8 @@ bool DMACtrl::isSG(void) {
  * @param offset address
  * @param value value
  */
-void DMACtrl::setMem(volatile uint32_t *mem_address, uint32_t offset, uint32_t value) {
+template<class Backend>
+void DMACtrlT<Backend>::setMem(volatile uint32_t *mem_address, uint32_t offset, uint32_t value) {
    mem_address[offset>>2] = value;
 }
 
@@ -191,30 +271,161 @@ void DMACtrl::setMem(volatile uint32_t *mem_address, uint32_t offset, uint32_t v
  * @param offset address
  * @return value
  */
-uint32_t DMACtrl::getMem(volatile uint32_t *mem_address, uint32_t offset) {
+template<class Backend>
+uint32_t DMACtrlT<Backend>::getMem(volatile uint32_t *mem_address, uint32_t offset) {
    return(mem_address[offset>>2]);
 }
 
+/**
+ * @brief Get STATUS word of a block descriptor
+ *
+ * Acquire load: data and descriptor fields written by the engine before STATUS
+ * (a software engine publishes it after a release fence) are visible once Cmplt is seen.
+ *
+ * @param mem_address block descriptors memory
+ * @param desc block descriptor index
+ * @return value
+ */
+template<class Backend>
+uint32_t DMACtrlT<Backend>::getDescStatus(volatile uint32_t *mem_address, uint32_t desc) {
+   return __atomic_load_n(mem_address + ((STATUS + DESC_SIZE * desc) >> 2), __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Set STATUS word of a block descriptor
+ *
+ * Release store: reads of block data by the consumer are complete before the engine
+ * sees the descriptor available again.
+ *
+ * @param mem_address block descriptors memory
+ * @param desc block descriptor index
+ * @param value value
+ */
+template<class Backend>
+void DMACtrlT<Backend>::setDescStatus(volatile uint32_t *mem_address, uint32_t desc, uint32_t value) {
+   __atomic_store_n(mem_address + ((STATUS + DESC_SIZE * desc) >> 2), value, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Set address width of AXI DMA core
+ *
+ * With address width greater than 32 bit, MSB registers (CURDESC_MSB, TAILDESC_MSB,
+ * START/DESTINATION_ADDRESS_MSB) are written and buffers/descriptors can be located
+ * above 4 GB. It must match "Address Width" parameter of AXI DMA IP.
+ *
+ * @param bits address width (32 to 64)
+ *
+ * @throws runtime_error if address width is not valid
+ */
+template<class Backend>
+void DMACtrlT<Backend>::setAddressWidth(uint8_t bits) {
+
+   if(bits < 32 || bits > 64)
+      throw std::runtime_error(std::string(__func__) + ": address width not valid");
+
+   addrWidth = bits;
+}
+
+/**
+ * @brief Set 64 bit address register of DMA channel
+ *
+ * MSB register (following LSB register) is written first: writing TAILDESC LSB register starts the engine.
+ *
+ * @param ch channel
+ * @param reg address register (LSB)
+ * @param addr address
+ *
+ * @throws runtime_error if address exceeds 32 bit with 32 bit address width
+ */
+template<class Backend>
+void DMACtrlT<Backend>::setChAddress(Channel ch, Register reg, uint64_t addr) {
+
+   if(addrWidth > 32)
+      setChRegister(ch, (Register) (reg + 4), (uint32_t) (addr >> 32));
+   else if(addr >> 32)
+      throw std::runtime_error(std::string(__func__) + ": address exceeds 32 bit");
+
+   setChRegister(ch, reg, (uint32_t) addr);
+}
+
+/**
+ * @brief Set 64 bit address word of block descriptor
+ *
+ * @param mem_address memory mapped area
+ * @param offset address word (LSB), MSB word follows
+ * @param addr address
+ *
+ * @throws runtime_error if address exceeds 32 bit with 32 bit address width
+ */
+template<class Backend>
+void DMACtrlT<Backend>::setDescAddress(volatile uint32_t *mem_address, uint32_t offset, uint64_t addr) {
+
+   if(addrWidth <= 32 && (addr >> 32))
+      throw std::runtime_error(std::string(__func__) + ": address exceeds 32 bit");
+
+   // LSB/MSB words are 8 byte aligned: a single 64 bit store (little endian)
+   *reinterpret_cast<volatile uint64_t *>(mem_address + (offset>>2)) = addr;
+}
+
+/**
+ * @brief Store block descriptors into descriptors memory
+ *
+ * Descriptors are copied with 64 bit volatile stores (8 per descriptor) instead of
+ * field by field 32 bit writes; memcpy is not used since it can issue unaligned or
+ * cache maintenance accesses not allowed on device memory.
+ *
+ * @param bdmem block descriptors memory
+ * @param first index of first block descriptor in memory
+ * @param bds block descriptors
+ * @param n number of block descriptors
+ */
+void DMACtrlBase::storeDescriptors(volatile uint32_t *bdmem, uint32_t first, const Descriptor *bds, uint32_t n) {
+
+   volatile uint64_t *dst = reinterpret_cast<volatile uint64_t *>(bdmem + (first * DESC_SIZE >> 2));
+   const unsigned char *src = reinterpret_cast<const unsigned char *>(bds);
+
+   for(uint32_t i=0; i < n * (DESC_SIZE / 8); i++) {
+      uint64_t w;
+      std::memcpy(&w, src + 8 * i, 8);
+      dst[i] = w;
+   }
+}
+
+/**
+ * @brief Get 64 bit address word of block descriptor
+ *
+ * @param mem_address memory mapped area
+ * @param offset address word (LSB), MSB word follows
+ * @return address
+ */
+template<class Backend>
+uint64_t DMACtrlT<Backend>::getDescAddress(volatile uint32_t *mem_address, uint32_t offset) {
+   return ( ((uint64_t) getMem(mem_address, offset + 4) << 32) | getMem(mem_address, offset) );
+}
+
 /**
  * @brief Print status of DMA channel (DMASR register)
  *
+ * @param ch channel
+ *
  * @throws runtime_error if DMA channel is not set
  */
-void DMACtrl::getStatus(void) {
+template<class Backend>
+void DMACtrlT<Backend>::getStatus(Channel ch) {
 
-   if(channel == UNKNOWN)
+   if(ch == UNKNOWN)
       throw std::runtime_error(std::string(__func__) + ": DMA channel is not set");
 
-   uint32_t status = getRegister(regs["DMASR"]);
+   uint32_t status = getChRegister(ch, DMASR);
 
    std::ios::fmtflags f(std::cout.flags());
    std::cout.setf(std::ios::hex, std::ios::basefield);  // set hex as the basefield
    std::cout.setf(std::ios::showbase);                  // activate showbase
 
-   if(channel == S2MM)
-      std::cout << "Stream to memory-mapped status (" << status << "@" << regs["DMACR"] << "): ";
-   else if(channel == MM2S)
-      std::cout << "Memory-mapped to stream status (" << status << "@" << regs["DMACR"] << "): ";
+   if(ch == S2MM)
+      std::cout << "Stream to memory-mapped status (" << status << "@" << unsigned(channelBase(ch) + DMACR) << "): ";
+   else if(ch == MM2S)
+      std::cout << "Memory-mapped to stream status (" << status << "@" << unsigned(channelBase(ch) + DMACR) << "): ";
 
    if (status & 0x00000001) std::cout << " halted"; else std::cout << " running";
    if (status & 0x00000002) std::cout << " idle";
@@ -232,7 +443,7 @@ void DMACtrl::getStatus(void) {
    // restore ios:fmtflags
    std::cout.flags(f);
 
-   if(isSG()) {
+   if(isSG(ch)) {
       uint8_t nirq = (status & 0x00FF0000) >> 16;
       std::cout << " IRQThresholdSts: " << unsigned(nirq);
    }
@@ -243,101 +454,151 @@ void DMACtrl::getStatus(void) {
 /**
  * @brief Get IRQioc (IRQ I/O completed) status of DMA channel (DMASR register)
  *
+ * @param ch channel
+ *
  * @return true: IRQioc is triggered
  * @return false: IRQioc is not triggered
  *
  * @throws runtime_error if DMA channel is not set
  */
-bool DMACtrl::IRQioc(void) {
+template<class Backend>
+bool DMACtrlT<Backend>::IRQioc(Channel ch) {
 
-   if(channel == UNKNOWN)
+   if(ch == UNKNOWN)
       throw std::runtime_error(std::string(__func__) + ": DMA channel is not set");
 
-   return( getRegister(regs["DMASR"]) & (1<<12) );
+   return( getChRegister(ch, DMASR) & (1<<12) );
 }
 
 /**
  * @brief Clear IRQioc (IRQ I/O completed) status of DMA channel (DMASR register)
  *
+ * @param ch channel
+ *
  * @throws runtime_error if DMA channel is not set
  */
-void DMACtrl::clearIRQioc(void) {
+template<class Backend>
+void DMACtrlT<Backend>::clearIRQioc(Channel ch) {
 
-   if(channel == UNKNOWN)
+   if(ch == UNKNOWN)
       throw std::runtime_error(std::string(__func__) + ": DMA channel is not set");
 
-   uint32_t status = getRegister(regs["DMASR"]);
-   setRegister(regs["DMASR"], status & ~(1<<12));
+   uint32_t status = getChRegister(ch, DMASR);
+   setChRegister(ch, DMASR, status & ~(1<<12));
+}
+
+/**
+ * @brief Get scatter-gather state of selected DMA channel
+ *
+ * @param func caller name
+ *
+ * @return channel state
+ *
+ * @throws runtime_error if DMA channel is not set
+ * @throws runtime_error if DMA channel in scatter-gather mode is not initialized
+ */
+template<class Backend>
+DMACtrlBase::ChannelState &DMACtrlT<Backend>::sgState(const char *func) {
+
+   if(channel == UNKNOWN)
+      throw std::runtime_error(std::string(func) + ": DMA channel is not set");
+
+   if(!chs[channel].initsg)
+      throw std::runtime_error(std::string(func) + ": Scatter-Gather is not initialized");
+
+   return chs[channel];
 }
 
 /**
- * @brief Get starting address of the buffer space related to a block descriptor
+ * @brief Get starting address of the buffer space related to a S2MM block descriptor
  *
  * @param desc descriptor number
  *
- * @return address 
+ * @return address
  *
  * @throws runtime_error descriptor index is out of bound
  */
-uint32_t DMACtrl::getBufferAddress(uint8_t desc) {
+template<class Backend>
+uint64_t DMACtrlT<Backend>::getBufferAddress(uint32_t desc) {
 
-   if(desc > ndesc-1)
+   ChannelState &c = chs[S2MM];
+
+   if(desc > c.ndesc-1)
       throw std::runtime_error(std::string(__func__) + ": descriptor is out of bound");
 
-   return ( getMem(bdmem, BUFFER_ADDRESS + (DESC_SIZE * desc)) );
+   return ( getDescAddress(c.bdmem, BUFFER_ADDRESS + (DESC_SIZE * desc)) );
 }
 
 /**
  * @brief Initialize DMA channel in direct mode
  *
+ * @param ch channel
  * @param blocksize size of DMA transfer (packet size)
  * @param addr PS source/destination address for DMA transfer
  *
- * @throws runtime_error if DMA channel is not set 
+ * @throws runtime_error if DMA channel is not set
  * @throws runtime_error if DMA channel is not configured for direct mode
  *
  */
-void DMACtrl::initDirect(uint32_t blocksize, uint32_t addr) {
+template<class Backend>
+void DMACtrlT<Backend>::initDirect(Channel ch, uint32_t blocksize, uint64_t addr) {
 
-   if(isSG())
+   if(isSG(ch))
       throw std::runtime_error(std::string(__func__) + ": DMA channel is not configured for Direct mode");
 
-   if(channel == S2MM)
-      setRegister(regs["DESTINATION_ADDRESS"], addr);
-   else if(channel == MM2S)
-      setRegister(regs["START_ADDRESS"], addr);
-   else throw std::runtime_error(std::string(__func__) + ": DMA channel is not set");
+   ChannelState &c = chs[ch];
+
+   // DESTINATION_ADDRESS (S2MM) or START_ADDRESS (MM2S)
+   setChAddress(ch, ADDRESS, addr);
 
-   size = blocksize;
+   c.size = blocksize;
+   c.targetaddr = addr;
+   c.segments.assign(1, Segment{ nullptr, addr, 0, 1 });
+   c.txPending = false;
+   c.directReported = true;
+   c.sequence = 0;
 
    // DMACR[0]  = 1 : run dma
    // DMACR[12] = 1 : enable Interrupt on Complete
    // DMACR[13] = 1 : enable Delay Interrupt
    // DMACR[14] = 1 : enable Error Interrupt
    // DMACR[15] = 1 : [reserved] - no effect
-   setRegister(regs["DMACR"], 0xF001);
+   setChRegister(ch, DMACR, 0xF001);
 }
 
 /**
  * @brief Start DMA channel direct mode data transfer
  *
+ * S2MM channel transfer of a block is started; MM2S transfers are started by tx()
+ *
+ * @param ch channel
+ *
  * @throws runtime_error if DMA channel is not set
  * @throws runtime_error if DMA channel is not configured for direct mode
  */
-void DMACtrl::runDirect(void) {
+template<class Backend>
+void DMACtrlT<Backend>::runDirect(Channel ch) {
 
-   if(channel == UNKNOWN)
+   if(ch == UNKNOWN)
       throw std::runtime_error(std::string(__func__) + ": DMA channel is not set");
 
-   if(isSG())
+   if(isSG(ch))
       throw std::runtime_error(std::string(__func__) + ": DMA channel is not configured for Direct mode");
 
-   setRegister(regs["LENGTH"], size);
+   if(ch == S2MM) {
+      ChannelState &c = chs[ch];
+      // previous block is given back to device before it is filled again
+      if(c.autoSync)
+         syncBlock(c, 0, 0, c.size, DEVICE_OWNER);
+      c.directReported = false;
+      setChRegister(ch, LENGTH, c.size);
+   }
 }
 
 /**
  * @brief Initialize DMA channel in scatter-gather mode
  *
+ * @param ch channel
  * @param baseaddr BRAM/RAM memory address dedicated to block descriptors
  * @param n number of block descriptors to initialize
  * @param blocksize size of DMA transfer (packet size)
@@ -345,73 +606,265 @@ void DMACtrl::runDirect(void) {
  *
  * @throws runtime_error if DMA channel is not set
  * @throws runtime_error if DMA channel is not configured for scatter gather mode
+ * @throws runtime_error if block descriptors memory can not be mapped
+ * @throws runtime_error if a descriptor or buffer address exceeds 32 bit with 32 bit address width
+ *
+ * @note in full-duplex mode MM2S and S2MM channels need distinct block descriptors memory areas
  */
-void DMACtrl::initSG(uint32_t baseaddr, uint8_t n, uint32_t blocksize, uint32_t tgtaddr) {
+template<class Backend>
+void DMACtrlT<Backend>::initSG(Channel ch, uint64_t baseaddr, uint32_t n, uint32_t blocksize, uint64_t tgtaddr) {
 
-   if(channel == UNKNOWN)
+   if(ch == UNKNOWN)
+      throw std::runtime_error(std::string(__func__) + ": DMA channel is not set");
+
+   if(!isSG(ch))
+      throw std::runtime_error(std::string(__func__) + ": DMA channel is not configured for Scatter-Gather mode");
+
+   chs[ch].segments.assign(1, Segment{ nullptr, tgtaddr, 0, n });
+
+   initSGRing(ch, baseaddr, n, blocksize);
+}
+
+/**
+ * @brief Initialize DMA channel in scatter-gather mode with a ring spanning several DMA buffers
+ *
+ * Each DMA buffer holds as many consecutive blocks as fit in it; block descriptors are
+ * assigned to buffers in list order (e.g. udmabuf0..udmabuf7), so ring capacity is the sum
+ * of buffers capacity. A completed transfer never spans two buffers and its BlockView
+ * points into the related buffer.
+ *
+ * @param ch channel
+ * @param baseaddr BRAM/RAM memory address dedicated to block descriptors (DESC_SIZE bytes each)
+ * @param blocksize size of DMA transfer (packet size)
+ * @param bufs DMA buffers (must outlive the ring)
+ *
+ * @throws runtime_error if DMA channel is not S2MM
+ * @throws runtime_error if DMA channel is not configured for scatter gather mode
+ * @throws runtime_error if a DMA buffer is null or smaller than blocksize
+ * @throws runtime_error if a descriptor or buffer address exceeds 32 bit with 32 bit address width
+ *
+ * @see getSGDescCount()
+ */
+template<class Backend>
+void DMACtrlT<Backend>::initSG(Channel ch, uint64_t baseaddr, uint32_t blocksize, const std::vector<DMABuffer *> &bufs) {
+
+   if(ch != S2MM)
+      throw std::runtime_error(std::string(__func__) + ": multi-buffer ring is supported only on S2MM channel");
+
+   if(!isSG(ch))
+      throw std::runtime_error(std::string(__func__) + ": DMA channel is not configured for Scatter-Gather mode");
+
+   if(bufs.empty() || blocksize == 0)
+      throw std::runtime_error(std::string(__func__) + ": DMA buffer list or block size not valid");
+
+   std::vector<Segment> segments;
+   uint32_t n = 0;
+
+   for(DMABuffer *b : bufs) {
+
+      if(b == nullptr || b->getBufferSize() < blocksize)
+         throw std::runtime_error(std::string(__func__) + ": DMA buffer " + std::to_string(segments.size()) + " not valid");
+
+      uint32_t count = b->getBufferSize() / blocksize;
+      segments.push_back(Segment{ b, b->getPhysicalAddress(), n, count });
+      n += count;
+   }
+
+   chs[ch].segments = std::move(segments);
+
+   initSGRing(ch, baseaddr, n, blocksize);
+}
+
+/**
+ * @brief Initialize DMA channel in scatter-gather mode with block descriptors allocated in a DMA buffer
+ *
+ * Block descriptors are placed from the start of the DMA buffer, so no BRAM (and no
+ * /dev/mem window) is needed and ring size is limited only by buffer size.
+ * If CPU cache is enabled on the DMA buffer, descriptors are updated in batches followed
+ * by explicit cache sync (each descriptor fills a 64 byte cache line).
+ * Data can be placed in the same DMA buffer after the descriptors.
+ *
+ * @param ch channel
+ * @param descbuf DMA buffer for block descriptors (must outlive the ring)
+ * @param n number of block descriptors to initialize
+ * @param blocksize size of DMA transfer (packet size)
+ * @param tgtaddr PS source/destination address for DMA transfer
+ *
+ * @throws runtime_error if DMA channel is not set
+ * @throws runtime_error if DMA channel is not configured for scatter gather mode
+ * @throws runtime_error if DMA buffer is too small for block descriptors
+ * @throws runtime_error if a descriptor or buffer address exceeds 32 bit with 32 bit address width
+ */
+template<class Backend>
+void DMACtrlT<Backend>::initSG(Channel ch, DMABuffer &descbuf, uint32_t n, uint32_t blocksize, uint64_t tgtaddr) {
+
+   if(ch == UNKNOWN)
       throw std::runtime_error(std::string(__func__) + ": DMA channel is not set");
 
-   if(!isSG())
+   if(!isSG(ch))
       throw std::runtime_error(std::string(__func__) + ": DMA channel is not configured for Scatter-Gather mode");
 
-   bdmem = (uint32_t *) mmap(NULL, n * DESC_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, dh, baseaddr);
-   descaddr = baseaddr;
-   targetaddr = tgtaddr;
-   size = blocksize;
-   ndesc = n;
+   if((uint64_t) n * DESC_SIZE > descbuf.getBufferSize())
+      throw std::runtime_error(std::string(__func__) + ": DMA buffer is too small for block descriptors");
 
-   initSGDescriptors();
+   chs[ch].segments.assign(1, Segment{ nullptr, tgtaddr, 0, n });
+
+   initSGRing(ch, descbuf.getPhysicalAddress(), n, blocksize, &descbuf);
+}
+
+/**
+ * @brief Map block descriptors memory and initialize ring of DMA channel
+ *
+ * @param ch channel
+ * @param baseaddr BRAM/RAM memory address dedicated to block descriptors
+ * @param n number of block descriptors
+ * @param blocksize size of DMA transfer (packet size)
+ * @param descbuf DMA buffer holding block descriptors at baseaddr (nullptr: descriptors memory from backend)
+ *
+ * The ring can be initialized again (e.g. on run restart): previous descriptors mapping
+ * is reused if it covers the new ring, otherwise it is replaced.
+ *
+ * @throws runtime_error if block descriptors memory can not be mapped
+ * @throws runtime_error if a descriptor or buffer address exceeds 32 bit with 32 bit address width
+ */
+template<class Backend>
+void DMACtrlT<Backend>::initSGRing(Channel ch, uint64_t baseaddr, uint32_t n, uint32_t blocksize, DMABuffer *descbuf) {
+
+   ChannelState &c = chs[ch];
+
+   c.initsg = false;
+   c.sequence = 0;
+
+   if(descbuf != nullptr) {
+      backend->unmapDescriptors(ch);
+      c.bdmem = (volatile uint32_t *) descbuf->buf;
+   } else {
+      // ring initialized again on the same descriptors memory: mapping is reused by backend
+      c.bdmem = backend->mapDescriptors(ch, baseaddr, (size_t) n * DESC_SIZE);
+      if(c.bdmem == nullptr)
+         throw std::runtime_error(std::string(__func__) + ": can not map block descriptors memory");
+   }
+   c.descbuf = descbuf;
+   c.descaddr = baseaddr;
+   c.targetaddr = c.segments.front().addr;
+   c.size = blocksize;
+   c.ndesc = n;
+
+   initSGDescriptors(ch);
 }
 
 /**
  * @brief Start DMA channel scatter-gather mode data transfer
  *
+ * @param ch channel
+ *
  * @throws runtime_error if DMA channel in scatter-gather mode is not initialized
  */
-void DMACtrl::runSG(void) {
+template<class Backend>
+void DMACtrlT<Backend>::runSG(Channel ch) {
+
+   ChannelState &c = chs[ch];
 
-   if(!initsg)
+   if(!c.initsg)
       throw std::runtime_error(std::string(__func__) + ": Scatter-Gather is not initialized");
 
-   // start channel with complete interrupt and cyclic mode
-   setRegister(regs["DMACR"], (ndesc << 16) + 0x1011);
-   setRegister(regs["TAILDESC"], descaddr + (DESC_SIZE * (ndesc-1)));
+   if(ch == MM2S) {
+      // start channel with complete interrupt, BDs are queued by tx()
+      setChRegister(ch, DMACR, (1 << 16) + 0x1001);
+      c.txHead = 0;
+      c.txTail = 0;
+      c.txCount = 0;
+      return;
+   }
+
+   // IRQThreshold is 8 bit wide: completion is tracked with BD STATUS flags
+   uint32_t threshold = std::min<uint32_t>(c.ndesc, IRQ_THRESHOLD_MAX);
+
+   // BDs completed in a previous run must not be reported
+   for(uint32_t i=0; i<c.ndesc; i++)
+      setMem(c.bdmem, STATUS + (DESC_SIZE * i), 0);
+   syncDesc(c, 0, c.ndesc, DEVICE_OWNER);
+
+   if(c.cyclic) {
+      // start channel with complete interrupt and cyclic mode
+      setChRegister(ch, DMACR, (threshold << 16) + 0x1011);
+   } else {
+      // start channel with complete interrupt, engine stops at TAILDESC
+      setChRegister(ch, DMACR, (threshold << 16) + 0x1001);
+   }
+   setChAddress(ch, TAILDESC, c.descaddr + (DESC_SIZE * (c.ndesc-1)));
 
    // reset BD indexes
-   blockOffset = 0;
-   blockSize = 0;
-   bdStartIndex = 0;
-   bdStopIndex = 0;
-   lastIrqThreshold = ndesc;
+   c.blockOffset = 0;
+   c.blockSize = 0;
+   c.blockFirst = 0;
+   c.blockLast = 0;
+   c.blockSegment = 0;
+   c.bdStartIndex = 0;
+   c.scanned = 0;
+   c.held = 0;
+   c.releaseIndex = 0;
 
    // reset transfer state
-   blockTransfer = false;
-   bufferTransfer = false;
+   c.blockTransfer = false;
+   c.bufferTransfer = false;
+   c.syncPending = false;
 }
 
 /**
  * @brief Init scatter-gather descriptors
+ *
+ * @param ch channel
+ *
+ * @throws runtime_error if a descriptor or buffer address exceeds 32 bit with 32 bit address width
  */
-void DMACtrl::initSGDescriptors(void) {
-
-   uint32_t i;
-
-   // Initialization of Descriptors Array
-   for(i=0; i < (DESC_SIZE * ndesc); i++)
-      setMem(bdmem, i, 0);
+template<class Backend>
+void DMACtrlT<Backend>::initSGDescriptors(Channel ch) {
+
+   ChannelState &c = chs[ch];
+   Descriptor batch[DESC_BATCH];
+   uint32_t n = 0;
+
+   // NXTDESC and BUFFER_ADDRESS MSB words are ignored by a 32 bit core
+   if(addrWidth <= 32) {
+      bool above = (c.descaddr + (DESC_SIZE * (uint64_t) (c.ndesc-1))) >> 32;
+      for(const Segment &seg : c.segments)
+         above |= (seg.addr + ((uint64_t) c.size * (seg.count-1))) >> 32;
+      if(above)
+         throw std::runtime_error(std::string(__func__) + ": address exceeds 32 bit");
+   }
 
-   // Write descriptors arrays
-   for(i=0; i<ndesc; i++) {
-      setMem(bdmem, NXTDESC + (DESC_SIZE * i), descaddr + NXTDESC + (DESC_SIZE * (i+1)));
-      setMem(bdmem, BUFFER_ADDRESS + (DESC_SIZE * i), targetaddr + (size * i));
-      setMem(bdmem, CONTROL + (DESC_SIZE * i), size);
+   // descriptors are built in a local array and stored in batches
+   for(const Segment &seg : c.segments) {
+      for(uint32_t i=seg.first; i<seg.first+seg.count; i++) {
+
+         // last descriptor points back to the first one (ring)
+         uint64_t nxtdesc = (i == c.ndesc-1) ? c.descaddr : c.descaddr + (DESC_SIZE * (uint64_t) (i+1));
+         uint64_t bufaddr = seg.addr + ((uint64_t) c.size * (i - seg.first));
+
+         Descriptor &bd = batch[n++];
+         bd = Descriptor{};
+         bd.nxtdesc = (uint32_t) nxtdesc;
+         bd.nxtdescMsb = (uint32_t) (nxtdesc >> 32);
+         bd.bufferAddress = (uint32_t) bufaddr;
+         bd.bufferAddressMsb = (uint32_t) (bufaddr >> 32);
+         bd.control = c.size;
+
+         if(n == DESC_BATCH || i == c.ndesc-1) {
+            storeDescriptors(c.bdmem, i + 1 - n, batch, n);
+            n = 0;
+         }
+      }
    }
 
-   setMem(bdmem, NXTDESC + (DESC_SIZE * (ndesc-1)), 0);
+   c.lengths.assign(c.ndesc, 0);
+   c.frames.assign(c.ndesc, 0);
+
+   syncDesc(c, 0, c.ndesc, DEVICE_OWNER);
 
-   setRegister(regs["CURDESC"], descaddr);
+   setChAddress(ch, CURDESC, c.descaddr);
 
-   initsg = true;
+   c.initsg = true;
 }
 
 /**
@@ -421,13 +874,17 @@ void DMACtrl::initSGDescriptors(void) {
  *
  * @throws runtime_error if DMA channel in scatter-gather mode is not initialized
  */
-void DMACtrl::incSGDescTable(uint8_t desc) {
+template<class Backend>
+void DMACtrlT<Backend>::incSGDescTable(uint32_t desc) {
 
-   if(!initsg)
-      throw std::runtime_error(std::string(__func__) + ": Scatter-Gather is not initialized");
+   ChannelState &c = sgState(__func__);
+
+   if(c.segments.size() > 1)
+      throw std::runtime_error(std::string(__func__) + ": not supported on multi-buffer ring");
 
-   for(uint8_t i=0; i<ndesc; i++)
-      setMem(bdmem, BUFFER_ADDRESS + (DESC_SIZE * i), targetaddr + (size * (ndesc * desc + i)));
+   for(uint32_t i=0; i<c.ndesc; i++)
+      setDescAddress(c.bdmem, BUFFER_ADDRESS + (DESC_SIZE * i), c.targetaddr + ((uint64_t) c.size * (c.ndesc * desc + i)));
+   syncDesc(c, 0, c.ndesc, DEVICE_OWNER);
 }
 
 /**
@@ -435,18 +892,20 @@ void DMACtrl::incSGDescTable(uint8_t desc) {
  *
  * @throws runtime_error if DMA channel in scatter-gather mode is not initialized
  */
-void DMACtrl::dumpSGDescTable(void) {
+template<class Backend>
+void DMACtrlT<Backend>::dumpSGDescTable(void) {
 
-   if(!initsg)
-      throw std::runtime_error(std::string(__func__) + ": Scatter-Gather is not initialized");
+   ChannelState &c = sgState(__func__);
+
+   syncDesc(c, 0, c.ndesc, CPU_OWNER);
 
-   for(uint8_t i=0; i<ndesc; i++) {
-      uint32_t bdaddr = descaddr + (DESC_SIZE * i);
-      uint32_t nxtdesc = getMem(bdmem, NXTDESC + (DESC_SIZE * i));
-      uint32_t buffer_address = getMem(bdmem, BUFFER_ADDRESS + (DESC_SIZE * i));
-      uint32_t control =  getMem(bdmem, CONTROL + (DESC_SIZE * i));
-      uint32_t status = getMem(bdmem, STATUS + (DESC_SIZE * i));
-      std::cout << "BD" << i << ": addr " << std::hex << bdaddr << " NXTDESC " << nxtdesc << ", BUFFER_ADDRESS " << buffer_address << \
+   for(uint32_t i=0; i<c.ndesc; i++) {
+      uint64_t bdaddr = c.descaddr + (DESC_SIZE * i);
+      uint64_t nxtdesc = getDescAddress(c.bdmem, NXTDESC + (DESC_SIZE * i));
+      uint64_t buffer_address = getDescAddress(c.bdmem, BUFFER_ADDRESS + (DESC_SIZE * i));
+      uint32_t control =  getMem(c.bdmem, CONTROL + (DESC_SIZE * i));
+      uint32_t status = getMem(c.bdmem, STATUS + (DESC_SIZE * i));
+      std::cout << "BD" << unsigned(i) << ": addr " << std::hex << bdaddr << " NXTDESC " << nxtdesc << ", BUFFER_ADDRESS " << buffer_address << \
          ", CONTROL " << control << " , STATUS " << status << std::dec << std::endl;
    }
 }
@@ -456,14 +915,16 @@ void DMACtrl::dumpSGDescTable(void) {
  *
  * @throws runtime_error if DMA channel in scatter-gather mode is not initialized
  */
-void DMACtrl::dumpSGDescAllStatus(void) {
+template<class Backend>
+void DMACtrlT<Backend>::dumpSGDescAllStatus(void) {
 
-   if(!initsg)
-      throw std::runtime_error(std::string(__func__) + ": Scatter-Gather is not initialized");
+   ChannelState &c = sgState(__func__);
+
+   syncDesc(c, 0, c.ndesc, CPU_OWNER);
 
-   for(uint8_t i=0; i<ndesc; i++) {
-      uint32_t status = getMem(bdmem, STATUS + (DESC_SIZE * i));
-      std::cout << "BD" << i << ": STATUS " << std::hex << status << std::dec << std::endl;
+   for(uint32_t i=0; i<c.ndesc; i++) {
+      uint32_t status = getMem(c.bdmem, STATUS + (DESC_SIZE * i));
+      std::cout << "BD" << unsigned(i) << ": STATUS " << std::hex << status << std::dec << std::endl;
    }
 }
 
@@ -474,13 +935,14 @@ void DMACtrl::dumpSGDescAllStatus(void) {
  *
  * @note This method must be used when cyclic mode is not enabled
  */
-void DMACtrl::clearSGDescAllStatus(void) {
-   
-   if(!initsg)
-      throw std::runtime_error(std::string(__func__) + ": Scatter-Gather is not initialized");
+template<class Backend>
+void DMACtrlT<Backend>::clearSGDescAllStatus(void) {
+
+   ChannelState &c = sgState(__func__);
 
-   for(uint8_t i=0; i<ndesc; i++)
-      setMem(bdmem, STATUS + (DESC_SIZE * i), 0);
+   for(uint32_t i=0; i<c.ndesc; i++)
+      setMem(c.bdmem, STATUS + (DESC_SIZE * i), 0);
+   syncDesc(c, 0, c.ndesc, DEVICE_OWNER);
 }
 
 /**
@@ -491,12 +953,12 @@ void DMACtrl::clearSGDescAllStatus(void) {
  *
  * @throws runtime_error if DMA channel in scatter-gather mode is not initialized
  */
-uint32_t DMACtrl::getSGDescBufferAddress(uint8_t desc) {
+template<class Backend>
+uint64_t DMACtrlT<Backend>::getSGDescBufferAddress(uint32_t desc) {
 
-   if(!initsg)
-      throw std::runtime_error(std::string(__func__) + ": Scatter-Gather is not initialized");
+   ChannelState &c = sgState(__func__);
 
-   return ( getMem(bdmem, BUFFER_ADDRESS + (DESC_SIZE * desc)) );
+   return ( getDescAddress(c.bdmem, BUFFER_ADDRESS + (DESC_SIZE * desc)) );
 }
 
 /**
@@ -506,8 +968,9 @@ uint32_t DMACtrl::getSGDescBufferAddress(uint8_t desc) {
  *
  * @note This method can be used after a S2MM DMA transfer
  */
-uint32_t DMACtrl::getBlockOffset(void) {
-   return(blockOffset);
+template<class Backend>
+uint32_t DMACtrlT<Backend>::getBlockOffset(void) {
+   return(chs[S2MM].blockOffset);
 }
 
 /**
@@ -517,107 +980,760 @@ uint32_t DMACtrl::getBlockOffset(void) {
  *
  * @note This method can be used after a S2MM DMA transfer
  */
-uint32_t DMACtrl::getBlockSize(void) {
-   return(blockSize);
-}
-
-void DMACtrl::calibrateWaitTime(uint16_t count) {
-
-   if(count > maxLoop) {
-      curWait *= 2;
-      if(curWait > maxWait) curWait = maxWait;
-   } else if(count < minLoop) {
-      curWait /= 2;
-      if(curWait < minWait) curWait = minWait;
-   }
+template<class Backend>
+uint32_t DMACtrlT<Backend>::getBlockSize(void) {
+   return(chs[S2MM].blockSize);
 }
 
 /**
- * @brief Start a DMA S2MM data transfer
+ * @brief Get transferred bytes of a S2MM block descriptor
  *
- * DMA mode (direct or scatter-gather) is checked and related method is invoked.
- * In case of long wait time during scatter-gather transfer (when timeout is not specified)
- * the transfer is switched from buffer (all descriptors) to single block descriptor.
+ * @param desc block descriptor index
  *
- * @param timeout timeout value (us) for non-blocking call (0: infinite)
+ * @return bytes transferred at last completion of the descriptor (BD STATUS[25:0])
  *
- * @return true: data transfer completed
- * @return false: timeout expired
+ * @throws runtime_error descriptor index is out of bound
+ *
+ * @note value is captured when the descriptor is returned by rx()/tryComplete()
  */
-bool DMACtrl::rx(uint32_t timeout) {
+template<class Backend>
+uint32_t DMACtrlT<Backend>::getDescLength(uint32_t desc) {
 
-   // check if DMA mode is scatter-gather or direct
-   if(!isSG()) return(directRx(timeout));
+   ChannelState &c = chs[S2MM];
 
-   // check if block or buffer transfer is in progress
-   if(blockTransfer) return(blockRx(timeout));
-   if(bufferTransfer) return(bufferRx(timeout));
+   if(desc >= c.lengths.size())
+      throw std::runtime_error(std::string(__func__) + ": descriptor is out of bound");
 
-   if(curWait == maxWait) {
-      // in case of low rate send ready BDs and don't wait all BDs
-      return(blockRx(timeout));
-   } else return(bufferRx(timeout));
+   return c.lengths[desc];
 }
 
 /**
- * @brief Start a direct mode DMA S2MM data transfer
+ * @brief Get packets of last DMA transfer
  *
- * In case of long wait time (when timeout is not specified)
- * the wait time is calibrated within two limit values. 
+ * @return packets (offsets relative to start of transfer)
  *
- * @param timeout timeout value (us) for non-blocking call (0: infinite)
+ * @note This method can be used after a S2MM DMA transfer
+ */
+template<class Backend>
+const std::vector<Packet> &DMACtrlT<Backend>::getPackets(void) {
+   return chs[S2MM].packets;
+}
+
+/**
+ * @brief Get descriptors range of last DMA transfer
  *
- * @return true: data transfer completed
- * @return false: timeout expired
+ * @return block range
  *
- * @throws runtime_error if DMA channel is not configured for direct mode
- * @throws runtime_error if DMA channel is not S2MM
- * @throws runtime_error if DMA channel is not running
+ * @note This method can be used after a S2MM DMA transfer
  */
-bool DMACtrl::directRx(uint32_t timeout) {
-   
-   if(isSG())
-      throw std::runtime_error(std::string(__func__) + ": DMA channel is not configured for Direct mode");
+template<class Backend>
+DMACtrlBase::BlockRange DMACtrlT<Backend>::getBlockRange(void) {
 
-   if(channel != S2MM)
-      throw std::runtime_error(std::string(__func__) + ": DMA Scatter-Gather channel != S2MM");
-
-   if(!isRunning())
-      throw std::runtime_error(std::string(__func__) + ": DMA channel not running");
-
-   uint16_t nloops = 0;
-   uint32_t waitTime = 0;
-   uint32_t step;
-
-   if(timeout == 0)
-      step = curWait;
-   else
-      step = minWait;
+   ChannelState &c = chs[S2MM];
+   return BlockRange{ c.blockFirst, c.blockLast, c.blockOffset, c.blockSize, c.blockBytes, c.blockSegment };
+}
 
-   do {
+/**
+ * @brief Get zero-copy view of last DMA transfer
+ *
+ * @return block view pointing into bound DMA buffer (see setBuffer()) or into
+ * DMA buffer of ring segment (multi-buffer ring)
+ *
+ * @throws runtime_error if DMA buffer is not bound
+ * @throws runtime_error if transfer is outside of DMA buffer
+ *
+ * @note This method can be used after a S2MM DMA transfer
+ */
+template<class Backend>
+BlockView DMACtrlT<Backend>::getBlockView(void) {
+
+   ChannelState &c = chs[S2MM];
+   uint64_t addr;
+   DMABuffer *dbuf = segmentBuffer(c, c.blockSegment, addr);
+
+   if(dbuf == nullptr)
+      throw std::runtime_error(std::string(__func__) + ": DMA buffer is not bound");
+
+   uint64_t start = addr - dbuf->getPhysicalAddress() + c.blockOffset;
+   if(addr < dbuf->getPhysicalAddress() || start + c.blockSize > dbuf->getBufferSize())
+      throw std::runtime_error(std::string(__func__) + ": transfer is outside of DMA buffer");
+
+   BlockView view;
+   view.bytes = ConstSpan<std::byte>(reinterpret_cast<const std::byte *>(dbuf->buf + start), c.blockSize);
+   view.lengths = isSG(S2MM) ? ConstSpan<uint32_t>(c.lengths.data() + c.blockFirst, c.blockLast - c.blockFirst + 1) :
+      ConstSpan<uint32_t>(&c.blockBytes, 1);
+   view.packets = ConstSpan<Packet>(c.packets.data(), c.packets.size());
+   view.first = c.blockFirst;
+   view.last = c.blockLast;
+   view.offset = start;
+   view.segment = c.blockSegment;
+   view.sequence = c.blockSequence;
+   view.timestamp = c.blockTime;
+
+   return view;
+}
+
+/**
+ * @brief Store completed DMA transfer
+ *
+ * @param c channel state
+ * @param first first block descriptor index
+ * @param last last block descriptor index
+ * @param offset offset of data from target address
+ * @param size size of data
+ * @param bytes transferred bytes
+ */
+template<class Backend>
+void DMACtrlT<Backend>::setBlock(ChannelState &c, uint32_t first, uint32_t last, uint32_t offset, uint32_t size, uint32_t bytes) {
+
+   c.blockFirst = first;
+   c.blockLast = last;
+   c.blockOffset = offset;
+   c.blockSize = size;
+   c.blockBytes = bytes;
+   c.blockSequence = c.sequence++;
+   c.blockTime = std::chrono::steady_clock::now();
+}
+
+/**
+ * @brief Bind DMA buffer to a channel
+ *
+ * Target address of DMA transfers must be inside the DMA buffer.
+ *
+ * @param ch channel
+ * @param dbuf DMA buffer (must outlive the binding)
+ *
+ * @throws runtime_error if DMA channel is not set
+ */
+template<class Backend>
+void DMACtrlT<Backend>::setBuffer(Channel ch, DMABuffer &dbuf) {
+
+   if(ch == UNKNOWN)
+      throw std::runtime_error(std::string(__func__) + ": DMA channel is not set");
+
+   chs[ch].buffer = &dbuf;
+}
+
+/**
+ * @brief Enable automatic cache sync of received blocks
+ *
+ * Each block returned by rx()/tryComplete() is synced for CPU (exactly the completed
+ * range) before being returned, and given back to device by release() (non-cyclic ring),
+ * at next rx()/tryComplete() (cyclic ring) or at next run (direct mode).
+ * It allows reading cached DMA buffers (open(name, true)) safely; with uncached
+ * buffers sync has no cost.
+ *
+ * @param enable true: enable automatic sync
+ *
+ * @throws runtime_error if DMA buffer is not bound to S2MM channel
+ */
+template<class Backend>
+void DMACtrlT<Backend>::setAutoSync(bool enable) {
+
+   ChannelState &c = chs[S2MM];
+   uint64_t addr;
+
+   if(enable && segmentBuffer(c, 0, addr) == nullptr)
+      throw std::runtime_error(std::string(__func__) + ": DMA buffer is not bound");
+
+   c.autoSync = enable;
+   c.syncPending = false;
+}
+
+/**
+ * @brief Get DMA buffer and physical address of a ring segment
+ *
+ * @param c channel state
+ * @param segment ring segment (0 for single buffer ring and direct mode)
+ * @param addr physical address of segment start
+ *
+ * @return DMA buffer (nullptr if not bound)
+ */
+template<class Backend>
+DMABuffer *DMACtrlT<Backend>::segmentBuffer(const ChannelState &c, uint32_t segment, uint64_t &addr) {
+
+   DMABuffer *dbuf = c.buffer;
+   addr = c.targetaddr;
+
+   if(segment < c.segments.size()) {
+      const Segment &seg = c.segments[segment];
+      if(seg.buffer != nullptr)
+         dbuf = seg.buffer;
+      addr = seg.addr;
+   }
+
+   return dbuf;
+}
+
+/**
+ * @brief Sync cache of a block of received data
+ *
+ * @param c channel state
+ * @param segment ring segment of block
+ * @param offset offset of block from segment start
+ * @param size size of block
+ * @param owner CPU_OWNER: block is returned to consumer, DEVICE_OWNER: block is given back to device
+ *
+ * @throws runtime_error if block is outside of DMA buffer
+ * @throws runtime_error if cache sync fails
+ */
+template<class Backend>
+void DMACtrlT<Backend>::syncBlock(ChannelState &c, uint32_t segment, uint32_t offset, uint32_t size, uint8_t owner) {
+
+   uint64_t addr;
+   DMABuffer *dbuf = segmentBuffer(c, segment, addr);
+
+   if(dbuf == nullptr || size == 0)
+      return;
+
+   uint64_t start = addr - dbuf->getPhysicalAddress() + offset;
+   if(addr < dbuf->getPhysicalAddress() || start + size > dbuf->getBufferSize())
+      throw std::runtime_error(std::string(__func__) + ": transfer is outside of DMA buffer");
+
+   bool done = (owner == CPU_OWNER) ? dbuf->syncForCpu(start, size, DMA_FROM_DEVICE) :
+      dbuf->syncForDevice(start, size, DMA_FROM_DEVICE);
+
+   if(!done)
+      throw std::runtime_error(std::string(__func__) + ": cache sync failed");
+}
+
+/**
+ * @brief Give back to device last block returned in cyclic mode
+ *
+ * @param c channel state
+ */
+template<class Backend>
+void DMACtrlT<Backend>::syncPending(ChannelState &c) {
+
+   if(!c.syncPending)
+      return;
+
+   c.syncPending = false;
+   syncBlock(c, c.syncSegment, c.syncOffset, c.syncSize, DEVICE_OWNER);
+}
+
+/**
+ * @brief Set wait policy used while waiting for transfer completion
+ *
+ * @param ch channel (S2MM: rx(), MM2S: tx())
+ * @param p wait policy (e.g. AdaptiveWait, BusyPoll, SpinSleep, FixedWait, EWMAWait)
+ *
+ * @throws runtime_error if DMA channel is not set
+ * @throws runtime_error if wait policy is null
+ *
+ * @note when interrupt wait is configured and timeout is not specified, rx() blocks on
+ * interrupt regardless of wait policy
+ */
+template<class Backend>
+void DMACtrlT<Backend>::setWaitPolicy(Channel ch, std::unique_ptr<WaitPolicy> p) {
+
+   if(ch == UNKNOWN)
+      throw std::runtime_error(std::string(__func__) + ": DMA channel is not set");
+
+   if(!p)
+      throw std::runtime_error(std::string(__func__) + ": wait policy is null");
+
+   chs[ch].policy = std::move(p);
+}
+
+/**
+ * @brief Relax CPU for an idle step
+ *
+ * @param ch channel
+ * @param us wait time (us), 0: busy-poll
+ */
+template<class Backend>
+void DMACtrlT<Backend>::idle(Channel ch, uint32_t us) {
+
+   if(us == 0)
+      WaitPolicy::relax();
+   else
+      waitEvent(ch, us);
+}
+
+/**
+ * @brief Open UIO device for interrupt driven completion wait
+ *
+ * When an interrupt file descriptor is available, rx() and tx() methods block on it
+ * instead of sleeping: wait time becomes the upper bound of each wait step.
+ *
+ * @param ch channel (AXI DMA provides an interrupt line for each channel)
+ * @param uioname UIO device name (e.g. uio0)
+ *
+ * @return true: open success
+ * @return false: open failure
+ *
+ * @throws runtime_error if DMA channel is not set
+ *
+ * @note in scatter-gather mode the interrupt is raised every IRQThreshold (ndesc) blocks,
+ * so block transfers still rely on wait time for partial rings
+ */
+template<class Backend>
+bool DMACtrlT<Backend>::openUIO(Channel ch, std::string uioname) {
+
+   if(ch == UNKNOWN)
+      throw std::runtime_error(std::string(__func__) + ": DMA channel is not set");
+
+   std::string filename = "/dev/" + uioname;
+   int fd = ::open(filename.data(), O_RDWR);
+   if(fd < 0) {
+      std::cout << "E: can not open " << filename << std::endl;
+      return false;
+   }
+
+   stopPoller(ch);
+   closeUIO(ch);
+   chs[ch].irqfd = fd;
+   chs[ch].irqfdOwned = true;
+   armIRQ(ch);
+
+   return true;
+}
+
+/**
+ * @brief Set interrupt file descriptor for completion wait
+ *
+ * File descriptor must follow UIO semantics: a 4 bytes read returns the
+ * interrupt count, a 4 bytes write of 1 re-enables the interrupt.
+ * A pipe read end (4 bytes written per interrupt) or an eventfd (8 bytes counter)
+ * can be used as stand-in for testing: re-arm write is not supported by them and ignored.
+ *
+ * @param ch channel
+ * @param fd file descriptor (not closed by DMACtrl), -1 to disable interrupt wait
+ *
+ * @throws runtime_error if DMA channel is not set
+ */
+template<class Backend>
+void DMACtrlT<Backend>::setIrqFd(Channel ch, int fd) {
+
+   if(ch == UNKNOWN)
+      throw std::runtime_error(std::string(__func__) + ": DMA channel is not set");
+
+   stopPoller(ch);
+   closeUIO(ch);
+   chs[ch].irqfd = fd;
+   chs[ch].irqfdOwned = false;
+   armIRQ(ch);
+}
+
+/**
+ * @brief Close UIO device and go back to sleep based completion wait
+ *
+ * @param ch channel
+ */
+template<class Backend>
+void DMACtrlT<Backend>::closeUIO(Channel ch) {
+
+   if(ch == UNKNOWN)
+      return;
+
+   ChannelState &c = chs[ch];
+
+   if(c.irqfdOwned && c.irqfd >= 0)
+      ::close(c.irqfd);
+
+   c.irqfd = -1;
+   c.irqfdOwned = false;
+}
+
+/**
+ * @brief Enable UIO interrupt
+ *
+ * @param ch channel
+ *
+ * @throws runtime_error if interrupt can not be enabled
+ */
+template<class Backend>
+void DMACtrlT<Backend>::armIRQ(Channel ch) {
+
+   if(chs[ch].irqfd < 0)
+      return;
+
+   uint32_t enable = 1;
 
-      if(isIdle()) {
-         if(timeout == 0) 
-            calibrateWaitTime(nloops);
+   // stand-ins without interrupt control: pipe read end (EBADF), eventfd (EINVAL)
+   if(write(chs[ch].irqfd, &enable, sizeof(enable)) != sizeof(enable) && errno != EBADF && errno != EINVAL)
+      throw std::runtime_error(std::string(__func__) + ": can not enable interrupt");
+}
+
+/**
+ * @brief Wait for DMA interrupt or sleep
+ *
+ * Without interrupt file descriptor sleep for the wait time; otherwise block on
+ * file descriptor up to the wait time and acknowledge the interrupt.
+ *
+ * @param ch channel
+ * @param us wait time (us)
+ */
+template<class Backend>
+void DMACtrlT<Backend>::waitEvent(Channel ch, uint32_t us) {
+
+   if(chs[ch].irqfd < 0) {
+      usleep(us);
+      return;
+   }
+
+   struct pollfd pfd = { chs[ch].irqfd, POLLIN, 0 };
+   struct timespec ts = { (time_t) (us / 1000000), (long) (us % 1000000) * 1000 };
+
+   // a hung up stand-in is reported by ackIRQ() instead of waking up poll forever
+   if(ppoll(&pfd, 1, &ts, NULL) > 0 && (pfd.revents & (POLLIN | POLLHUP)))
+      ackIRQ(ch);
+}
+
+/**
+ * @brief Acknowledge UIO interrupt
+ *
+ * Consume interrupt count, clear DMA interrupt flags (DMASR) and re-enable UIO interrupt
+ *
+ * @param ch channel
+ *
+ * @throws runtime_error if interrupt count can not be read or file descriptor is closed by writer
+ */
+template<class Backend>
+void DMACtrlT<Backend>::ackIRQ(Channel ch) {
+
+   uint32_t count;
+   ssize_t n = read(chs[ch].irqfd, &count, sizeof(count));
+
+   if(n < 0 && errno == EINVAL) {
+      // eventfd stand-in: 8 bytes counter
+      uint64_t events;
+      n = read(chs[ch].irqfd, &events, sizeof(events));
+   }
+
+   // a count left unread keeps the file descriptor readable: wait would spin
+   if(n == 0)
+      throw std::runtime_error(std::string(__func__) + ": interrupt file descriptor is closed");
+   if(n < 0 && errno != EAGAIN && errno != EINTR)
+      throw std::runtime_error(std::string(__func__) + ": can not read interrupt count");
+
+   // DMASR[14:12] IOC_Irq, Dly_Irq, Err_Irq are cleared writing 1
+   uint32_t status = getChRegister(ch, DMASR);
+   if(status & 0x7000)
+      setChRegister(ch, DMASR, status & 0x7000);
+
+   armIRQ(ch);
+}
+
+/**
+ * @brief Get pollable file descriptor signaling DMA channel activity
+ *
+ * The returned file descriptor becomes readable when new data could be available:
+ * - UIO interrupt file descriptor, when interrupt wait is configured
+ * - otherwise an eventfd driven by an internal poller thread watching DMASR register
+ *
+ * When the file descriptor is readable, tryComplete() must be called until it returns false.
+ *
+ * @param ch channel
+ *
+ * @return file descriptor to be used with poll/epoll (owned by DMACtrl)
+ *
+ * @throws runtime_error if DMA channel is not set
+ * @throws runtime_error if eventfd can not be created
+ */
+template<class Backend>
+int DMACtrlT<Backend>::fd(Channel ch) {
+
+   if(ch == UNKNOWN)
+      throw std::runtime_error(std::string(__func__) + ": DMA channel is not set");
+
+   ChannelState &c = chs[ch];
+
+   if(c.irqfd >= 0)
+      return c.irqfd;
+
+   if(c.evfd < 0) {
+      c.evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if(c.evfd < 0)
+         throw std::runtime_error(std::string(__func__) + ": eventfd creation failed");
+
+      pollerStop[ch] = false;
+      c.poller = std::thread(&DMACtrlT::pollerLoop, this, ch);
+   }
+
+   return c.evfd;
+}
+
+/**
+ * @brief Stop poller thread and close its eventfd
+ *
+ * @param ch channel
+ */
+template<class Backend>
+void DMACtrlT<Backend>::stopPoller(Channel ch) {
+
+   ChannelState &c = chs[ch];
+
+   if(c.evfd < 0)
+      return;
+
+   pollerStop[ch] = true;
+   if(c.poller.joinable())
+      c.poller.join();
+
+   ::close(c.evfd);
+   c.evfd = -1;
+}
+
+/**
+ * @brief Poller thread: signal eventfd on each DMASR change
+ *
+ * @param ch channel
+ */
+template<class Backend>
+void DMACtrlT<Backend>::pollerLoop(Channel ch) {
+
+   ChannelState &c = chs[ch];
+   uint32_t last = 0;
+   uint64_t one = 1;
+
+   while(!pollerStop[ch]) {
+
+      uint32_t status = getChRegister(ch, DMASR);
+      if(status != last) {
+         write(c.evfd, &one, sizeof(one));
+         last = status;
+      }
 
-         // send whole buffer
-         blockOffset = 0;
-         blockSize = size;
+      usleep(pollerPeriod);
+   }
+}
+
+/**
+ * @brief Wait for DMA transfer completion
+ *
+ * Completion is checked, then CPU is relaxed according to wait policy
+ * (or waiting for interrupt) until completion or timeout.
+ *
+ * @param ch channel
+ * @param poll one-shot completion check method
+ * @param timeout timeout value (us) for non-blocking call (0: infinite)
+ *
+ * @return true: data transfer completed
+ * @return false: timeout expired
+ */
+template<class Backend>
+bool DMACtrlT<Backend>::waitCompletion(Channel ch, bool (DMACtrlT::*poll)(void), uint32_t timeout) {
+
+   WaitPolicy &policy = *chs[ch].policy;
+   uint32_t nloops = 0;
+   uint32_t waitTime = 0;
+   auto start = std::chrono::steady_clock::now();
+
+   do {
 
+      if((this->*poll)()) {
+         policy.completed(nloops, waitTime, timeout);
          return true;
       }
 
-      // relax CPU
-      usleep(step);
+      // relax CPU (or wait for interrupt)
+      if(isIrqDriven(ch) && timeout == 0)
+         waitEvent(ch, irqWait);
+      else
+         idle(ch, policy.next(nloops, waitTime, timeout));
 
-      waitTime += step;
-      nloops++; 
-         
-   } while ( (waitTime < timeout) || (timeout == 0) );
+      waitTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+      nloops++;
+
+   } while( (waitTime < timeout) || (timeout == 0) );
 
    return false;
 }
 
+/**
+ * @brief Start a DMA S2MM data transfer
+ *
+ * DMA mode (direct or scatter-gather) is checked and related method is invoked.
+ * In case of low data rate reported by wait policy during scatter-gather transfer
+ * the transfer is switched from buffer (all descriptors) to single block descriptor.
+ *
+ * @param timeout timeout value (us) for non-blocking call (0: infinite)
+ *
+ * @return true: data transfer completed
+ * @return false: timeout expired (direct mode: also when last transfer was already returned)
+ */
+template<class Backend>
+bool DMACtrlT<Backend>::rx(uint32_t timeout) {
+
+   ChannelState &c = chs[S2MM];
+
+   // check if DMA mode is scatter-gather or direct
+   if(!isSG(S2MM)) return(directRx(timeout));
+
+   syncPending(c);
+
+   // non-cyclic ring: ready BDs are handed out until released
+   // packet mode: transfers end on packet boundaries
+   if(!c.cyclic || c.packetMode) return(blockRx(timeout));
+
+   // check if block or buffer transfer is in progress
+   if(c.blockTransfer) return(blockRx(timeout));
+   if(c.bufferTransfer) return(bufferRx(timeout));
+
+   if(c.policy->lowRate()) {
+      // in case of low rate send ready BDs and don't wait all BDs
+      return(blockRx(timeout));
+   } else return(bufferRx(timeout));
+}
+
+/**
+ * @brief Start a DMA S2MM data transfer returning a zero-copy view
+ *
+ * @param view view of transferred data into bound DMA buffer, valid when true is returned
+ * @param timeout timeout value (us) for non-blocking call (0: infinite)
+ *
+ * @return true: data transfer completed
+ * @return false: timeout expired
+ *
+ * @see rx(uint32_t), getBlockView()
+ */
+template<class Backend>
+bool DMACtrlT<Backend>::rx(BlockView &view, uint32_t timeout) {
+
+   if(!rx(timeout))
+      return false;
+
+   view = getBlockView();
+   return true;
+}
+
+/**
+ * @brief Check without waiting for a completed DMA S2MM data transfer returning a zero-copy view
+ *
+ * @param view view of transferred data into bound DMA buffer, valid when true is returned
+ *
+ * @return true: data transfer completed
+ * @return false: no data available
+ *
+ * @see tryComplete(BlockRange &), getBlockView()
+ */
+template<class Backend>
+bool DMACtrlT<Backend>::tryComplete(BlockView &view) {
+
+   BlockRange range;
+
+   if(!tryComplete(range))
+      return false;
+
+   view = getBlockView();
+   return true;
+}
+
+/**
+ * @brief Check without waiting for a completed DMA S2MM data transfer
+ *
+ * Pending interrupt (or poller event) is acknowledged, then DMA channel is checked once.
+ * In scatter-gather mode all ready block descriptors are returned (unless a buffer
+ * transfer started by rx() is in progress).
+ *
+ * @param range ready block descriptors range, valid when true is returned
+ *
+ * @return true: data transfer completed
+ * @return false: no data available
+ *
+ * @throws runtime_error if DMA channel is not running
+ * @throws runtime_error if DMA channel in scatter-gather mode is not initialized
+ */
+template<class Backend>
+bool DMACtrlT<Backend>::tryComplete(BlockRange &range) {
+
+   ChannelState &c = chs[S2MM];
+
+   if(!isRunning(S2MM))
+      throw std::runtime_error(std::string(__func__) + ": DMA channel is not running");
+
+   if(c.irqfd >= 0) {
+      struct pollfd pfd = { c.irqfd, POLLIN, 0 };
+      if(poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLIN | POLLHUP)))
+         ackIRQ(S2MM);
+   } else if(c.evfd >= 0) {
+      uint64_t count;
+      read(c.evfd, &count, sizeof(count));
+   }
+
+   bool ready;
+
+   if(isSG(S2MM) && c.initsg)
+      syncPending(c);
+
+   if(!isSG(S2MM))
+      ready = directPoll();
+   else if(!c.initsg)
+      throw std::runtime_error(std::string(__func__) + ": Scatter-Gather is not initialized");
+   else if(c.bufferTransfer)
+      ready = bufferPoll();
+   else
+      ready = blockPoll();
+
+   if(ready)
+      range = getBlockRange();
+
+   return ready;
+}
+
+/**
+ * @brief Start a direct mode DMA S2MM data transfer
+ *
+ * Wait time between checks is provided by wait policy.
+ * A transfer is returned once: when it has already been returned the call returns
+ * false immediately (even with infinite timeout) until run() starts the next one.
+ *
+ * @param timeout timeout value (us) for non-blocking call (0: infinite)
+ *
+ * @return true: data transfer completed
+ * @return false: timeout expired or no transfer started since last returned one
+ *
+ * @throws runtime_error if DMA channel is not configured for direct mode
+ * @throws runtime_error if DMA channel is not running
+ */
+template<class Backend>
+bool DMACtrlT<Backend>::directRx(uint32_t timeout) {
+
+   if(isSG(S2MM))
+      throw std::runtime_error(std::string(__func__) + ": DMA channel is not configured for Direct mode");
+
+   if(!isRunning(S2MM))
+      throw std::runtime_error(std::string(__func__) + ": DMA channel not running");
+
+   // nothing to wait for until run()
+   if(chs[S2MM].directReported)
+      return false;
+
+   return(waitCompletion(S2MM, &DMACtrlT::directPoll, timeout));
+}
+
+/**
+ * @brief Check once for a completed direct mode DMA S2MM data transfer
+ *
+ * A transfer is returned once: next one is started by run().
+ *
+ * @return true: data transfer completed
+ * @return false: data transfer in progress (or already returned)
+ */
+template<class Backend>
+bool DMACtrlT<Backend>::directPoll(void) {
+
+   ChannelState &c = chs[S2MM];
+
+   if(c.directReported || !isIdle(S2MM))
+      return false;
+
+   c.directReported = true;
+
+   // LENGTH register reports bytes actually received (TLAST may end the packet early)
+   uint32_t bytes = getChRegister(S2MM, LENGTH) & BD_LENGTH_MASK;
+
+   setBlock(c, 0, 0, 0, bytes, bytes);
+   c.packets.assign(1, Packet{ 0, bytes, 0, 0, true, true });
+
+   if(c.autoSync)
+      syncBlock(c, 0, 0, bytes, CPU_OWNER);
+
+   return true;
+}
+
 /**
  * @brief Start a scatter-gather mode DMA S2MM data transfer
  *
@@ -628,87 +1744,312 @@ bool DMACtrl::directRx(uint32_t timeout) {
  * @return true: data transfer completed
  * @return false: timeout expired
  */
-bool DMACtrl::blockRx(uint32_t timeout) {
+template<class Backend>
+bool DMACtrlT<Backend>::blockRx(uint32_t timeout) {
 
-   if(!initsg)
+   if(!chs[S2MM].initsg)
       throw std::runtime_error(std::string(__func__) + ": Scatter-Gather is not initialized");
 
-   if(channel != S2MM)
-      throw std::runtime_error(std::string(__func__) + ": DMA Scatter-Gather channel != S2MM");
-
-   if(!isRunning())
+   if(!isRunning(S2MM))
       throw std::runtime_error(std::string(__func__) + ": DMA channel is not running");
 
-   uint16_t nloops = 0;
-   uint32_t waitTime = 0;
-   uint32_t step;
-   uint32_t status;
-   uint16_t irqThreshold = 0;
-   uint8_t readyBlocks = 0;
+   return(waitCompletion(S2MM, &DMACtrlT::blockPoll, timeout));
+}
 
-   if(timeout == 0)
-      step = curWait;
-   else
-      step = minWait;
+/**
+ * @brief Check once for ready block descriptors in scatter-gather mode
+ *
+ * Ready descriptors from the first one not yet handed out up to the end of the
+ * ring segment are returned (data is contiguous); next transfer continues on next
+ * segment or wraps to ring start.
+ * In non-cyclic mode descriptors not yet released are never scanned.
+ *
+ * @return true: one or more block descriptors are ready
+ * @return false: no block descriptor is ready
+ */
+template<class Backend>
+bool DMACtrlT<Backend>::blockPoll(void) {
 
-   blockTransfer = true;
+   ChannelState &c = chs[S2MM];
+   const Segment &seg = c.segments[segmentOf(c, c.bdStartIndex)];
+   uint32_t max = seg.first + seg.count - c.bdStartIndex;
+
+   if(!c.cyclic)
+      max = std::min(max, c.ndesc - c.held);
+
+   c.blockTransfer = true;
+
+   uint32_t n = scanRing(c, max);
 
-   do {
-      
-      status = getRegister(regs["DMASR"]);
-
-      readyBlocks = 0;
-
-      if(isIdle()) {
-         bdStopIndex = ndesc - 1;
-         readyBlocks = bdStopIndex - bdStartIndex + 1;
-         lastIrqThreshold = ndesc;
-         blockTransfer = false;
-      } else {
-         irqThreshold = (status & 0x00FF0000) >> 16;
-         if(irqThreshold < lastIrqThreshold) {      // there is an increment on ready BDs...
-            readyBlocks = (ndesc - irqThreshold - bdStartIndex);
-            lastIrqThreshold = irqThreshold;
-         }
-      }
-      
 #ifdef DEBUG
-      std::cout << nloops << ") irqThreshold: " << irqThreshold << " lastIrqThreshold: " << lastIrqThreshold << \
-         " readyBlocks: " << unsigned(readyBlocks) << " bdStartIndex: " << unsigned(bdStartIndex) << \
-         " bdStopIndex: " << unsigned(bdStopIndex) << std::endl;
+   std::cout << "readyBlocks: " << n << " bdStartIndex: " << c.bdStartIndex << " held: " << c.held << std::endl;
 #endif
 
-      if(readyBlocks > 0) {
+   if(n == 0)
+      return false;
+
+   if(c.packetMode && n < max) {
+      // scan stopped on a pending descriptor: hold back trailing partial packet
+      uint32_t k = n;
+      while(k > 0 && !(c.frames[c.bdStartIndex + k - 1] & (BD_STATUS_EOF >> 26)))
+         k--;
+      if(k == 0)
+         return false;
+      n = k;
+   }
+
+   takeBlocks(c, n);
+
+   // block transfer is in progress until ring end is reached
+   c.blockTransfer = (c.bdStartIndex != 0);
+
+   return true;
+}
+
+/**
+ * @brief Scan STATUS Cmplt flag of descriptors following bdStartIndex
+ *
+ * Scan resumes from descriptors already found completed by previous calls.
+ *
+ * @param c channel state
+ * @param max maximum number of descriptors to scan
+ *
+ * @return number of consecutive completed descriptors from bdStartIndex
+ */
+template<class Backend>
+uint32_t DMACtrlT<Backend>::scanRing(ChannelState &c, uint32_t max) {
+
+   if(c.scanned < max)
+      syncDesc(c, c.bdStartIndex + c.scanned, max - c.scanned, CPU_OWNER);
+
+   while(c.scanned < max) {
+
+      uint32_t desc = c.bdStartIndex + c.scanned;
+      uint32_t status = getDescStatus(c.bdmem, desc);
+
+      if(!(status & BD_STATUS_CMPLT))
+         break;
+
+      if(status & BD_STATUS_ERR)
+         throw std::runtime_error(std::string(__func__) + ": block descriptor " + std::to_string(desc) + " transfer error");
+
+      c.lengths[desc] = status & BD_LENGTH_MASK;
+      c.frames[desc] = (status & (BD_STATUS_SOF | BD_STATUS_EOF)) >> 26;
+      c.scanned++;
+   }
+
+   // engine halts on DMA or SG errors
+   if(c.scanned == 0 && (getChRegister(S2MM, DMASR) & DMASR_ERR))
+      throw std::runtime_error(std::string(__func__) + ": DMA channel error");
+
+   return std::min(c.scanned, max);
+}
+
+/**
+ * @brief Hand out completed descriptors starting from bdStartIndex
+ *
+ * In cyclic mode STATUS words are cleared immediately (DMA engine sets them again on next
+ * lap), in non-cyclic mode descriptors are held until release().
+ *
+ * @param c channel state
+ * @param n number of descriptors
+ */
+template<class Backend>
+void DMACtrlT<Backend>::takeBlocks(ChannelState &c, uint32_t n) {
 
-         bdStopIndex = bdStartIndex + readyBlocks - 1;
+   uint32_t start = c.bdStartIndex;
+   uint32_t bytes = 0;
 
-         if(timeout == 0)
-            calibrateWaitTime(nloops);
+   for(uint32_t i=start; i<start+n; i++)
+      bytes += c.lengths[i];
 
-         // SG mode: a subset of BDs are available 
-         blockOffset = getBufferAddress(bdStartIndex) - targetaddr;
-         blockSize = size * (bdStopIndex - bdStartIndex + 1);
+   // data spans from first BD buffer up to the end of last BD transferred bytes
+   c.blockSegment = segmentOf(c, start);
+   setBlock(c, start, start + n - 1, getBufferAddress(start) - c.segments[c.blockSegment].addr, c.size * (n - 1) + c.lengths[start + n - 1], bytes);
 
 #ifdef DEBUG
-         std::cout << "BDs ready from " << unsigned(bdStartIndex) << " to " << unsigned(bdStopIndex) << \
-            " - offset: " << blockOffset << " size: " << blockSize << std::endl;
+   std::cout << "BDs ready from " << c.blockFirst << " to " << c.blockLast << \
+      " - offset: " << c.blockOffset << " size: " << c.blockSize << std::endl;
 #endif
 
-         if(bdStopIndex < (ndesc-1))
-            bdStartIndex = bdStopIndex + 1;
+   if(c.cyclic) {
+      for(uint32_t i=start; i<start+n; i++)
+         setDescStatus(c.bdmem, i, 0);
+      syncDesc(c, start, n, DEVICE_OWNER);
+   } else c.held += n;
+
+   if(c.autoSync) {
+      syncBlock(c, c.blockSegment, c.blockOffset, c.blockSize, CPU_OWNER);
+      if(c.cyclic) {
+         // given back at next rx()/tryComplete()
+         c.syncPending = true;
+         c.syncSegment = c.blockSegment;
+         c.syncOffset = c.blockOffset;
+         c.syncSize = c.size * n;
+      }
+   }
 
-         return true;
+   splitPackets(c);
+
+   c.bdStartIndex = (start + n) % c.ndesc;
+   c.scanned = 0;
+}
+
+/**
+ * @brief Sync CPU cache of block descriptors allocated in a cached DMA buffer
+ *
+ * No action is taken if descriptors are not in a DMA buffer or CPU cache is disabled on it.
+ *
+ * @param c channel state
+ * @param first first block descriptor index
+ * @param count number of block descriptors (range may wrap around ring end)
+ * @param owner CPU_OWNER: before reading descriptors, DEVICE_OWNER: after writing descriptors
+ */
+template<class Backend>
+void DMACtrlT<Backend>::syncDesc(ChannelState &c, uint32_t first, uint32_t count, uint8_t owner) {
+
+   if(c.descbuf == nullptr || !c.descbuf->isCacheOn() || count == 0)
+      return;
+
+   auto sync = (owner == DEVICE_OWNER) ? &DMABuffer::syncForDevice : &DMABuffer::syncForCpu;
+   uint8_t direction = (owner == DEVICE_OWNER) ? DMA_TO_DEVICE : DMA_FROM_DEVICE;
+   uint32_t n = std::min(count, c.ndesc - first);
+
+   (c.descbuf->*sync)(first * DESC_SIZE, n * DESC_SIZE, direction);
+
+   if(n < count)
+      (c.descbuf->*sync)(0, (count - n) * DESC_SIZE, direction);
+}
+
+/**
+ * @brief Get ring segment of a block descriptor
+ *
+ * @param c channel state
+ * @param desc block descriptor index
+ *
+ * @return segment index
+ */
+template<class Backend>
+uint32_t DMACtrlT<Backend>::segmentOf(const ChannelState &c, uint32_t desc) {
+
+   auto it = std::upper_bound(c.segments.begin(), c.segments.end(), desc,
+      [](uint32_t d, const Segment &seg) { return d < seg.first; });
+
+   return (uint32_t) (it - c.segments.begin()) - 1;
+}
+
+/**
+ * @brief Split last transfer in packets using descriptors RXSOF/RXEOF flags
+ *
+ * Packets crossing transfer boundaries (e.g. ring end in packet mode) are reported with
+ * sof or eof flag cleared.
+ *
+ * @param c channel state
+ */
+template<class Backend>
+void DMACtrlT<Backend>::splitPackets(ChannelState &c) {
+
+   const uint8_t sof = BD_STATUS_SOF >> 26;
+   const uint8_t eof = BD_STATUS_EOF >> 26;
+   bool open = false;
+
+   c.packets.clear();
+
+   for(uint32_t i=c.blockFirst; i<=c.blockLast; i++) {
+
+      if(!open || (c.frames[i] & sof)) {
+         // previous packet (if any) is truncated by a new start of frame
+         c.packets.push_back(Packet{ c.size * (i - c.blockFirst), 0, i, i, bool(c.frames[i] & sof), false });
+         open = true;
       }
 
-      // relax CPU
-      usleep(step);
+      Packet &p = c.packets.back();
+      p.size += c.lengths[i];
+      p.last = i;
 
-      waitTime += step;
-      nloops++; 
-      
-   } while ( (waitTime < timeout) || (timeout == 0) );
+      if(c.frames[i] & eof) {
+         p.eof = true;
+         open = false;
+      }
+   }
+}
 
-   return false;
+/**
+ * @brief Give block descriptors back to DMA engine
+ *
+ * In non-cyclic ring mode descriptors returned by rx() are owned by the consumer until
+ * released: STATUS words are cleared and TAILDESC is advanced, so DMA engine stops
+ * (back-pressure) instead of overwriting data still in use.
+ * Ranges must be released in the same order they are returned by rx().
+ * In cyclic mode the call has no effect.
+ *
+ * @param range block descriptors range returned by rx()/tryComplete()
+ *
+ * @throws runtime_error if DMA channel in scatter-gather mode is not initialized
+ * @throws runtime_error if range is not the next one to be released
+ */
+template<class Backend>
+void DMACtrlT<Backend>::release(const BlockRange &range) {
+
+   ChannelState &c = chs[S2MM];
+
+   if(!c.initsg)
+      throw std::runtime_error(std::string(__func__) + ": Scatter-Gather is not initialized");
+
+   if(c.cyclic)
+      return;
+
+   uint32_t n = range.last - range.first + 1;
+
+   if(range.first != c.releaseIndex || range.last < range.first || n > c.held)
+      throw std::runtime_error(std::string(__func__) + ": block descriptors released out of order");
+
+   if(c.autoSync)
+      syncBlock(c, range.segment, range.offset, c.size * n, DEVICE_OWNER);
+
+   for(uint32_t i=range.first; i<=range.last; i++)
+      setDescStatus(c.bdmem, i, 0);
+   syncDesc(c, range.first, n, DEVICE_OWNER);
+
+   c.held -= n;
+   c.releaseIndex = (range.last + 1) % c.ndesc;
+
+   // engine can fill descriptors up to the last released one
+   setChAddress(S2MM, TAILDESC, c.descaddr + (DESC_SIZE * range.last));
+}
+
+/**
+ * @brief Give block descriptors of a view back to DMA engine
+ *
+ * @param view block view returned by rx()/tryComplete()
+ *
+ * @see release(const BlockRange &)
+ */
+template<class Backend>
+void DMACtrlT<Backend>::release(const BlockView &view) {
+
+   uint64_t addr;
+   DMABuffer *dbuf = segmentBuffer(chs[S2MM], view.segment, addr);
+
+   // view offset is relative to the DMA buffer, range offset to the segment target address
+   uint32_t offset = (dbuf != nullptr) ? view.offset - (uint32_t) (addr - dbuf->getPhysicalAddress()) : view.offset;
+
+   release(BlockRange{ view.first, view.last, offset, (uint32_t) view.size(), 0, view.segment });
+}
+
+/**
+ * @brief Set cyclic mode of S2MM scatter-gather ring
+ *
+ * - cyclic (default): DMA engine loops over descriptors, data not consumed in time is overwritten
+ * - non-cyclic: descriptors returned by rx() must be given back with release()
+ *
+ * @param enable true: cyclic mode, false: non-cyclic (release) mode
+ *
+ * @note mode is applied by next run()
+ */
+template<class Backend>
+void DMACtrlT<Backend>::setCyclic(bool enable) {
+   chs[S2MM].cyclic = enable;
 }
 
 /**
@@ -722,56 +2063,249 @@ bool DMACtrl::blockRx(uint32_t timeout) {
  * @return false: timeout expired
  *
  * @throws runtime_error if DMA channel is not initialized
- * @throws runtime_error if DMA channel is not S2MM
  * @throws runtime_error if DMA channel is not running
  */
-bool DMACtrl::bufferRx(uint32_t timeout) {
+template<class Backend>
+bool DMACtrlT<Backend>::bufferRx(uint32_t timeout) {
 
    // timout: 0=infinite
 
-   if(!initsg)
+   if(!chs[S2MM].initsg)
       throw std::runtime_error(std::string(__func__) + ": Scatter-Gather is not initialized");
 
-   if(channel != S2MM)
-      throw std::runtime_error(std::string(__func__) + ": DMA Scatter-Gather channel != S2MM");
+   if(!isRunning(S2MM))
+      throw std::runtime_error(std::string(__func__) + ": DMA channel is not running");
+
+   chs[S2MM].bufferTransfer = true;
+
+   return(waitCompletion(S2MM, &DMACtrlT::bufferPoll, timeout));
+}
+
+/**
+ * @brief Check once for completion of all block descriptors in scatter-gather mode
+ *
+ * Transfer includes all descriptors from the first one not yet handed out up to the end
+ * of the ring segment (ring end with a single DMA buffer).
+ *
+ * @return true: all block descriptors are ready
+ * @return false: buffer transfer in progress
+ */
+template<class Backend>
+bool DMACtrlT<Backend>::bufferPoll(void) {
+
+   ChannelState &c = chs[S2MM];
+   const Segment &seg = c.segments[segmentOf(c, c.bdStartIndex)];
+   uint32_t max = seg.first + seg.count - c.bdStartIndex;
 
-   if(!isRunning())
+   // wait for all descriptors up to segment end
+   if(scanRing(c, max) < max)
+      return false;
+
+   takeBlocks(c, max);
+
+   c.bufferTransfer = false;
+
+   return true;
+}
+
+/**
+ * @brief Start a DMA MM2S data transfer
+ *
+ * Data is read from target buffer area [offset, offset+length) and sent as a single packet.
+ * - in direct mode the call waits for previous transfer completion, then transfer is started
+ *   writing START_ADDRESS and LENGTH registers
+ * - in scatter-gather mode the packet is split in block descriptors (blocksize bytes each) with
+ *   SOF flag on first and EOF flag on last descriptor; the call waits for free descriptors, then
+ *   descriptors are queued advancing TAILDESC register
+ *
+ * The call returns as soon as the transfer is started: data area can not be modified until
+ * transfer completion (see txFlush()).
+ *
+ * @param offset offset of data in target buffer
+ * @param length size of data
+ * @param timeout timeout value (us) for non-blocking call (0: infinite)
+ *
+ * @return true: data transfer started
+ * @return false: timeout expired
+ *
+ * @throws runtime_error if DMA channel is not running
+ * @throws runtime_error if DMA channel in scatter-gather mode is not initialized
+ * @throws runtime_error if data is outside of bound DMA buffer (scatter-gather mode without
+ * bound buffer: outside of ring area, ndesc * blocksize bytes)
+ * @throws runtime_error if data does not fit in LENGTH register (direct mode) or in block descriptors ring
+ * @throws runtime_error if a previous data transfer failed (DMA channel error or halted)
+ */
+template<class Backend>
+bool DMACtrlT<Backend>::tx(uint32_t offset, uint32_t length, uint32_t timeout) {
+
+   ChannelState &c = chs[MM2S];
+
+   if(!isRunning(MM2S))
       throw std::runtime_error(std::string(__func__) + ": DMA channel is not running");
 
-   uint16_t nloops = 0;
-   uint32_t waitTime = 0;
-   uint32_t step;
-   
-   if(timeout == 0)
-      step = curWait;
-   else
-      step = minWait;
+   if(length == 0)
+      return true;
 
-   bufferTransfer = true;
+   uint64_t addr;
+   DMABuffer *dbuf = segmentBuffer(c, 0, addr);
+   uint64_t end = (uint64_t) offset + length;
 
-   do {
+   if(dbuf != nullptr && (addr < dbuf->getPhysicalAddress() || addr - dbuf->getPhysicalAddress() + end > dbuf->getBufferSize()))
+      throw std::runtime_error(std::string(__func__) + ": data is outside of DMA buffer");
+
+   if(!isSG(MM2S)) {
+
+      if(length > BD_LENGTH_MASK)
+         throw std::runtime_error(std::string(__func__) + ": data size exceeds LENGTH register");
+
+      if(c.txPending && !waitCompletion(MM2S, &DMACtrlT::txDirectPoll, timeout))
+         return false;
+
+      setChAddress(MM2S, ADDRESS, c.targetaddr + offset);
+      setChRegister(MM2S, LENGTH, length);
+      c.txPending = true;
+
+      return true;
+   }
+
+   if(!c.initsg)
+      throw std::runtime_error(std::string(__func__) + ": Scatter-Gather is not initialized");
+
+   if(dbuf == nullptr && end > (uint64_t) c.size * c.ndesc)
+      throw std::runtime_error(std::string(__func__) + ": data is outside of ring area");
+
+   uint32_t nbd = (length + c.size - 1) / c.size;
+   if(nbd > c.ndesc)
+      throw std::runtime_error(std::string(__func__) + ": data size exceeds block descriptors ring");
+
+   c.txNeeded = nbd;
+   if(!waitCompletion(MM2S, &DMACtrlT::txRingPoll, timeout))
+      return false;
 
-      if(isIdle()) {
-         if(timeout == 0) 
-            calibrateWaitTime(nloops);
+   uint32_t bd = c.txHead;
+   for(uint32_t i=0; i<nbd; i++) {
 
-         // send whole buffer
-         blockOffset = 0;
-         blockSize = size * ndesc;
+      bd = (c.txHead + i) % c.ndesc;
 
-         bufferTransfer = false;
+      uint32_t len = (i == nbd-1) ? (length - c.size * i) : c.size;
+      uint32_t control = len;
+      if(i == 0) control |= BD_CONTROL_SOF;
+      if(i == nbd-1) control |= BD_CONTROL_EOF;
 
+      setDescAddress(c.bdmem, BUFFER_ADDRESS + (DESC_SIZE * bd), c.targetaddr + offset + (c.size * i));
+      setMem(c.bdmem, CONTROL + (DESC_SIZE * bd), control);
+      setMem(c.bdmem, STATUS + (DESC_SIZE * bd), 0);
+   }
+   syncDesc(c, c.txHead, nbd, DEVICE_OWNER);
+
+   c.txHead = (bd + 1) % c.ndesc;
+   c.txCount += nbd;
+
+   // engine fetches descriptors up to tail
+   setChAddress(MM2S, TAILDESC, c.descaddr + (DESC_SIZE * bd));
+
+   return true;
+}
+
+/**
+ * @brief Wait for completion of all started DMA MM2S data transfers
+ *
+ * @param timeout timeout value (us) for non-blocking call (0: infinite)
+ *
+ * @return true: data transfers completed
+ * @return false: timeout expired
+ *
+ * @throws runtime_error if a data transfer failed (DMA channel error or halted)
+ */
+template<class Backend>
+bool DMACtrlT<Backend>::txFlush(uint32_t timeout) {
+
+   ChannelState &c = chs[MM2S];
+
+   if(!isSG(MM2S)) {
+      if(!c.txPending)
          return true;
-      }
+      return(waitCompletion(MM2S, &DMACtrlT::txDirectPoll, timeout));
+   }
 
-      // relax CPU
-      usleep(step);
+   c.txNeeded = c.ndesc;
+   return(waitCompletion(MM2S, &DMACtrlT::txRingPoll, timeout));
+}
 
-      waitTime += step;
-      nloops++; 
- 
-   } while( (waitTime < timeout) || (timeout == 0) );
+/**
+ * @brief Check once for completion of direct mode DMA MM2S data transfer
+ *
+ * @return true: data transfer completed
+ * @return false: data transfer in progress
+ *
+ * @throws runtime_error if DMA channel reports an error or is halted
+ */
+template<class Backend>
+bool DMACtrlT<Backend>::txDirectPoll(void) {
+
+   uint32_t status = getChRegister(MM2S, DMASR);
+
+   // engine halts on DMA errors: transfer never completes
+   if(status & DMASR_ERR)
+      throw std::runtime_error(std::string(__func__) + ": DMA channel error");
+
+   if(status & 0x0001)
+      throw std::runtime_error(std::string(__func__) + ": DMA channel is halted");
+
+   if(!(status & 0x0002))
+      return false;
+
+   chs[MM2S].txPending = false;
+   return true;
+}
+
+/**
+ * @brief Reclaim completed MM2S block descriptors and check for free descriptors
+ *
+ * @return true: at least txNeeded descriptors are free
+ * @return false: not enough free descriptors
+ *
+ * @throws runtime_error if a block descriptor reports a transfer error
+ * @throws runtime_error if DMA channel reports an error or is halted with descriptors pending
+ */
+template<class Backend>
+bool DMACtrlT<Backend>::txRingPoll(void) {
+
+   ChannelState &c = chs[MM2S];
+
+   syncDesc(c, c.txTail, c.txCount, CPU_OWNER);
+
+   while(c.txCount > 0) {
+
+      uint32_t status = getDescStatus(c.bdmem, c.txTail);
+
+      if(!(status & BD_STATUS_CMPLT))
+         break;
+
+      if(status & BD_STATUS_ERR)
+         throw std::runtime_error(std::string(__func__) + ": block descriptor " + std::to_string(c.txTail) + " transfer error");
+
+      setDescStatus(c.bdmem, c.txTail, 0);
+      c.txTail = (c.txTail + 1) % c.ndesc;
+      c.txCount--;
+   }
+
+   if( (c.ndesc - c.txCount) >= c.txNeeded )
+      return true;
+
+   // engine halts on DMA or SG errors: pending descriptors never complete
+   uint32_t status = getChRegister(MM2S, DMASR);
+
+   if(status & DMASR_ERR)
+      throw std::runtime_error(std::string(__func__) + ": DMA channel error");
+
+   if(status & 0x0001)
+      throw std::runtime_error(std::string(__func__) + ": DMA channel is halted");
 
    return false;
 }
 
+/* controllers instantiated in the library */
+template class DMACtrlT<MMIOBackend>;
+template class DMACtrlT<SimBackend>;
+template class DMACtrlT<DMABackend>;
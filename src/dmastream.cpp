@@ -0,0 +1,303 @@
+#include <string>
+#include <stdexcept>
+#include <utility>
+#include <unistd.h>
+
+#include "dmastream.h"
+#include "simbackend.h"
+
+/**
+ * @brief DMAStream constructor
+ *
+ * @param dmac controller with S2MM channel initialized (not used by other threads while the stream runs)
+ * @param capacity queue capacity (transfers, rounded up to a power of two)
+ *
+ * @throws runtime_error if capacity is zero
+ */
+template<class Backend>
+DMAStreamT<Backend>::DMAStreamT(DMACtrlT<Backend> &dmac, size_t capacity) :
+   dmac(dmac), blocks(capacity), releases(capacity), policy(std::make_unique<SpinSleep>()) {
+}
+
+/**
+ * @brief DMAStream destructor
+ *
+ * Stop the acquisition thread
+ */
+template<class Backend>
+DMAStreamT<Backend>::~DMAStreamT(void) {
+   stop();
+}
+
+/**
+ * @brief Start acquisition thread
+ *
+ * S2MM channel must be initialized in scatter-gather mode and running (run() called).
+ * Statistics are cleared.
+ *
+ * @throws runtime_error if stream is already running
+ * @throws runtime_error if S2MM channel is not in scatter-gather mode
+ * @throws runtime_error if S2MM channel is in cyclic mode with automatic cache sync
+ */
+template<class Backend>
+void DMAStreamT<Backend>::start(void) {
+
+   if(thread.joinable())
+      throw std::runtime_error(std::string(__func__) + ": stream is already running");
+
+   // direct mode needs run() for each transfer
+   if(!dmac.isSG(DMACtrlBase::S2MM))
+      throw std::runtime_error(std::string(__func__) + ": DMA channel is not configured for Scatter-Gather mode");
+
+   // next rx() would give blocks back to the device while the consumer still reads them
+   if(dmac.isCyclic() && dmac.isAutoSync())
+      throw std::runtime_error(std::string(__func__) + ": automatic cache sync is not supported in cyclic mode");
+
+   pstats.published = pstats.dropped = pstats.fullWaits = pstats.stallTime = pstats.timeouts = pstats.highWater = 0;
+   cstats.releaseWaits = 0;
+
+   cyclic = dmac.isCyclic();
+   error = nullptr;
+   stopRequest = false;
+   running.store(true, std::memory_order_release);
+
+   thread = std::thread(&DMAStreamT::acquire, this);
+}
+
+/**
+ * @brief Stop acquisition thread
+ *
+ * Queued transfers can still be popped; pending releases are given back to the engine.
+ */
+template<class Backend>
+void DMAStreamT<Backend>::stop(void) {
+
+   stopRequest = true;
+   if(thread.joinable())
+      thread.join();
+}
+
+/**
+ * @brief Set wait policy of pop()
+ *
+ * @param p wait policy (default SpinSleep)
+ *
+ * @throws runtime_error if wait policy is null
+ */
+template<class Backend>
+void DMAStreamT<Backend>::setWaitPolicy(std::unique_ptr<WaitPolicy> p) {
+
+   if(!p)
+      throw std::runtime_error(std::string(__func__) + ": wait policy is null");
+
+   policy = std::move(p);
+}
+
+/**
+ * @brief Get next transfer without waiting (consumer thread)
+ *
+ * @param block transfer, valid when true is returned
+ *
+ * @return true: transfer available
+ * @return false: queue is empty
+ */
+template<class Backend>
+bool DMAStreamT<Backend>::tryPop(StreamBlock &block) {
+   return blocks.tryPop(block);
+}
+
+/**
+ * @brief Wait for next transfer (consumer thread)
+ *
+ * CPU is relaxed according to wait policy while queue is empty.
+ *
+ * @param block transfer, valid when true is returned
+ * @param timeout timeout value (us) for non-blocking call (0: infinite)
+ *
+ * @return true: transfer available
+ * @return false: timeout expired or acquisition thread stopped with empty queue
+ *
+ * @throws exception raised by rx() in acquisition thread (once queued transfers are consumed)
+ */
+template<class Backend>
+bool DMAStreamT<Backend>::pop(StreamBlock &block, uint32_t timeout) {
+
+   uint32_t nloops = 0;
+   uint32_t waitTime = 0;
+   auto start = std::chrono::steady_clock::now();
+
+   do {
+
+      if(blocks.tryPop(block)) {
+         policy->completed(nloops, waitTime, timeout);
+         return true;
+      }
+
+      if(!running.load(std::memory_order_acquire)) {
+         // last transfer may be published just before thread end
+         if(blocks.tryPop(block))
+            return true;
+         if(error)
+            std::rethrow_exception(std::exchange(error, nullptr));
+         return false;
+      }
+
+      uint32_t us = policy->next(nloops, waitTime, timeout);
+      if(us == 0)
+         WaitPolicy::relax();
+      else
+         usleep(us);
+
+      waitTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+      nloops++;
+
+   } while( (waitTime < timeout) || (timeout == 0) );
+
+   return false;
+}
+
+/**
+ * @brief Give block descriptors of a transfer back to the engine (consumer thread)
+ *
+ * Transfers must be released in the order they are popped; no effect in cyclic mode
+ * or once the acquisition thread is stopped (descriptors stay held until the ring is
+ * initialized again).
+ *
+ * @param block transfer returned by pop()/tryPop()
+ *
+ * @throws exception raised by rx() in acquisition thread, when it stopped the thread before
+ * the release could be queued (not thrown again by pop())
+ */
+template<class Backend>
+void DMAStreamT<Backend>::release(const StreamBlock &block) {
+
+   if(cyclic)
+      return;
+
+   if(releases.tryPush(block.range))
+      return;
+
+   cstats.releaseWaits.fetch_add(1, std::memory_order_relaxed);
+   while(!releases.tryPush(block.range)) {
+      if(!running.load(std::memory_order_acquire)) {
+         // release is lost: report why acquisition stopped
+         if(error)
+            std::rethrow_exception(std::exchange(error, nullptr));
+         return;
+      }
+      std::this_thread::yield();
+   }
+}
+
+/**
+ * @brief Get back-pressure statistics
+ *
+ * @return statistics since start()
+ */
+template<class Backend>
+StreamStats DMAStreamT<Backend>::getStats(void) {
+
+   StreamStats s;
+
+   s.published = pstats.published.load(std::memory_order_relaxed);
+   s.dropped = pstats.dropped.load(std::memory_order_relaxed);
+   s.fullWaits = pstats.fullWaits.load(std::memory_order_relaxed);
+   s.stallTime = pstats.stallTime.load(std::memory_order_relaxed);
+   s.timeouts = pstats.timeouts.load(std::memory_order_relaxed);
+   s.highWater = pstats.highWater.load(std::memory_order_relaxed);
+   s.releaseWaits = cstats.releaseWaits.load(std::memory_order_relaxed);
+
+   return s;
+}
+
+/**
+ * @brief Acquisition thread: call rx() and publish transfers until stop()
+ *
+ * An exception raised by the controller ends the thread and is forwarded to pop().
+ */
+template<class Backend>
+void DMAStreamT<Backend>::acquire(void) {
+
+   try {
+
+      while(!stopRequest.load(std::memory_order_relaxed)) {
+
+         drainReleases();
+
+         if(!dmac.rx(pollTimeout)) {
+            pstats.timeouts.fetch_add(1, std::memory_order_relaxed);
+            continue;
+         }
+
+         StreamBlock block;
+         block.range = dmac.getBlockRange();
+         block.sequence = dmac.getBlockSequence();
+         block.timestamp = dmac.getBlockTime();
+
+         publish(block);
+      }
+
+      drainReleases();
+
+   } catch(...) {
+      error = std::current_exception();
+   }
+
+   running.store(false, std::memory_order_release);
+}
+
+/**
+ * @brief Queue a transfer to the consumer
+ *
+ * Cyclic mode: a transfer finding the queue full is dropped. Non-cyclic mode: wait
+ * for a free slot, releasing consumed blocks meanwhile.
+ *
+ * @param block transfer
+ */
+template<class Backend>
+void DMAStreamT<Backend>::publish(const StreamBlock &block) {
+
+   if(!blocks.tryPush(block)) {
+
+      if(cyclic) {
+         pstats.dropped.fetch_add(1, std::memory_order_relaxed);
+         return;
+      }
+
+      auto start = std::chrono::steady_clock::now();
+      pstats.fullWaits.fetch_add(1, std::memory_order_relaxed);
+
+      while(!blocks.tryPush(block)) {
+         // descriptors of a transfer never queued stay held: stream must be restarted
+         if(stopRequest.load(std::memory_order_relaxed))
+            return;
+         drainReleases();
+         std::this_thread::yield();
+      }
+
+      pstats.stallTime.fetch_add(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count(),
+         std::memory_order_relaxed);
+   }
+
+   pstats.published.fetch_add(1, std::memory_order_relaxed);
+
+   uint64_t n = blocks.size();
+   if(n > pstats.highWater.load(std::memory_order_relaxed))
+      pstats.highWater.store(n, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Release block descriptors given back by the consumer
+ */
+template<class Backend>
+void DMAStreamT<Backend>::drainReleases(void) {
+
+   DMACtrlBase::BlockRange range;
+
+   while(releases.tryPop(range))
+      dmac.release(range);
+}
+
+template class DMAStreamT<MMIOBackend>;
+template class DMAStreamT<SimBackend>;
+template class DMAStreamT<DMABackend>;
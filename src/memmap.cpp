@@ -0,0 +1,115 @@
+#include <utility>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "memmap.h"
+
+/**
+ * @brief Take ownership of another file descriptor, closing the current one
+ *
+ * @param other file handle to move from
+ * @return this file handle
+ */
+FileHandle &FileHandle::operator=(FileHandle &&other) noexcept {
+
+   if(this != &other)
+      reset(other.release());
+
+   return *this;
+}
+
+/**
+ * @brief Give up ownership of file descriptor
+ *
+ * @return file descriptor (-1 if not open)
+ */
+int FileHandle::release(void) {
+
+   int f = fd;
+   fd = -1;
+   return f;
+}
+
+/**
+ * @brief Close current file descriptor and own a new one
+ *
+ * @param newfd new file descriptor (-1: none)
+ */
+void FileHandle::reset(int newfd) {
+
+   if(fd >= 0)
+      ::close(fd);
+
+   fd = newfd;
+}
+
+/**
+ * @brief MemMap move constructor
+ *
+ * @param other mapping to move from (left unmapped)
+ */
+MemMap::MemMap(MemMap &&other) noexcept :
+   base(std::exchange(other.base, nullptr)),
+   length(std::exchange(other.length, 0)),
+   shift(std::exchange(other.shift, 0)) {
+}
+
+/**
+ * @brief Take ownership of another mapping, unmapping the current one
+ *
+ * @param other mapping to move from (left unmapped)
+ * @return this mapping
+ */
+MemMap &MemMap::operator=(MemMap &&other) noexcept {
+
+   if(this != &other) {
+      unmap();
+      base = std::exchange(other.base, nullptr);
+      length = std::exchange(other.length, 0);
+      shift = std::exchange(other.shift, 0);
+   }
+
+   return *this;
+}
+
+/**
+ * @brief Map a file area (current mapping is unmapped first)
+ *
+ * @param fd file descriptor (e.g. /dev/mem, udmabuf device)
+ * @param size size of area
+ * @param offset offset of area in file
+ *
+ * @return true: map success
+ * @return false: map failure
+ */
+bool MemMap::map(int fd, size_t size, uint64_t offset) {
+
+   unmap();
+
+   uint64_t page = sysconf(_SC_PAGESIZE);
+   uint64_t aligned = offset & ~(page - 1);
+   size_t s = offset - aligned;
+
+   void *p = mmap(NULL, size + s, PROT_READ | PROT_WRITE, MAP_SHARED, fd, (off_t) aligned);
+   if(p == MAP_FAILED)
+      return false;
+
+   base = p;
+   length = size + s;
+   shift = s;
+
+   return true;
+}
+
+/**
+ * @brief Unmap area (no action if not mapped)
+ */
+void MemMap::unmap(void) {
+
+   if(base != nullptr)
+      munmap(base, length);
+
+   base = nullptr;
+   length = 0;
+   shift = 0;
+}
@@ -0,0 +1,582 @@
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <stdexcept>
+#include <algorithm>
+
+#include "simbackend.h"
+#include "dmactrl.h"
+
+/* DMASR bits */
+#define SR_HALTED          0x00000001
+#define SR_IDLE            0x00000002
+#define SR_SGINCLD         0x00000008
+#define SR_DMADECERR       0x00000040
+#define SR_SGINTERR        0x00000100
+#define SR_SGDECERR        0x00000400
+#define SR_IOC_IRQ         0x00001000
+#define SR_ERR_IRQ         0x00004000
+#define SR_IRQ             0x00007000
+#define SR_THRESHOLD       0x00FF0000
+
+/* DMACR bits */
+#define CR_RS              0x00000001
+#define CR_RESET           0x00000004
+#define CR_CYCLIC          0x00000010
+
+/* Block descriptor user application fields */
+#define APP0               0x20
+#define APP1               0x24
+
+/**
+ * @brief SimBackend constructor
+ *
+ * Allocate simulated memory and start the engine thread (channels are halted)
+ *
+ * @param membase physical address of simulated memory (block descriptors and data buffers)
+ * @param memsize size of simulated memory
+ * @param sg true: scatter-gather engine included (DMASR SGIncld), false: direct mode
+ *
+ * @throws runtime_error if memory can not be allocated
+ */
+SimBackend::SimBackend(uint64_t membase, size_t memsize, bool sg) : membase(membase), memsize(memsize), mem(nullptr, std::free), sg(sg) {
+
+   size_t size = (memsize + 4095) & ~(size_t) 4095;
+
+   mem.reset((uint8_t *) std::aligned_alloc(4096, size));
+   if(!mem)
+      throw std::runtime_error(std::string(__func__) + ": can not allocate simulated memory");
+   std::memset(mem.get(), 0, size);
+
+   for(auto &r : regs)
+      r = 0;
+   resetChannels();
+
+   engine = std::thread(&SimBackend::engineLoop, this);
+}
+
+/**
+ * @brief SimBackend constructor on an external memory area
+ *
+ * Simulated memory is not allocated: the engine reads descriptors and writes data
+ * into memory (e.g. a DMABuffer mapping, so descriptors placed in a DMA buffer are
+ * seen by the engine). Memory is not cleared and must outlive the backend.
+ *
+ * @param memory simulated memory area
+ * @param membase physical address of simulated memory
+ * @param memsize size of simulated memory
+ * @param sg true: scatter-gather engine included (DMASR SGIncld), false: direct mode
+ *
+ * @throws runtime_error if memory is null
+ */
+SimBackend::SimBackend(uint8_t *memory, uint64_t membase, size_t memsize, bool sg) : membase(membase), memsize(memsize), mem(memory, [](void *) {}), sg(sg) {
+
+   if(!mem)
+      throw std::runtime_error(std::string(__func__) + ": simulated memory is null");
+
+   for(auto &r : regs)
+      r = 0;
+   resetChannels();
+
+   engine = std::thread(&SimBackend::engineLoop, this);
+}
+
+/**
+ * @brief SimBackend destructor
+ *
+ * Stop the engine thread
+ */
+SimBackend::~SimBackend(void) {
+
+   {
+      std::lock_guard<std::mutex> lock(m);
+      stop = true;
+   }
+   cv.notify_all();
+   engine.join();
+}
+
+/**
+ * @brief Get pointer to simulated memory
+ *
+ * @param addr physical address
+ * @param size size of area
+ *
+ * @return pointer to area (nullptr: area is outside of simulated memory)
+ */
+uint8_t *SimBackend::memory(uint64_t addr, size_t size) {
+
+   if(addr < membase || addr - membase > memsize || size > memsize - (addr - membase))
+      return nullptr;
+
+   return mem.get() + (addr - membase);
+}
+
+/**
+ * @brief Set data arrival rate of S2MM stream source
+ *
+ * @param rate rate (bytes/s), 0: unlimited (data is written as fast as possible)
+ */
+void SimBackend::setRate(double rate) {
+
+   std::lock_guard<std::mutex> lock(m);
+   this->rate = (rate > 0) ? rate : 0;
+   eng[DMACtrlBase::S2MM].due = std::chrono::steady_clock::now();
+}
+
+/**
+ * @brief Set packet size (TLAST period) of S2MM stream source
+ *
+ * A packet spans block descriptors as needed (RXSOF on first, RXEOF on last one);
+ * last block descriptor of a packet is partially filled.
+ *
+ * @param size packet size (bytes), 0: each block descriptor (or direct transfer) is a packet
+ */
+void SimBackend::setPacketSize(uint32_t size) {
+
+   std::lock_guard<std::mutex> lock(m);
+   packetSize = size;
+   packetLeft = 0;
+}
+
+/**
+ * @brief Get completion time of last S2MM transfer
+ *
+ * @return completion time (epoch of steady_clock if no transfer completed)
+ */
+std::chrono::steady_clock::time_point SimBackend::getCompletionTime(void) {
+   return std::chrono::steady_clock::time_point(std::chrono::nanoseconds(completion.load(std::memory_order_acquire)));
+}
+
+/**
+ * @brief Get completion time of a S2MM block descriptor (APP0/APP1 fields)
+ *
+ * Read it before the descriptor is handed back to the engine (cyclic mode: before
+ * it is overwritten).
+ *
+ * @param bdaddr physical address of block descriptor
+ *
+ * @return completion time (epoch of steady_clock if descriptor is outside of simulated memory)
+ */
+std::chrono::steady_clock::time_point SimBackend::getCompletionTime(uint64_t bdaddr) {
+
+   volatile uint32_t *bd = (volatile uint32_t *) memory(bdaddr, DESC_SIZE);
+   if(bd == nullptr)
+      return std::chrono::steady_clock::time_point();
+
+   int64_t ns = (int64_t) (((uint64_t) bd[APP1>>2] << 32) | bd[APP0>>2]);
+   return std::chrono::steady_clock::time_point(std::chrono::nanoseconds(ns));
+}
+
+/**
+ * @brief Read a register
+ *
+ * @param offset register offset
+ * @return value (0 for unmodelled registers)
+ */
+uint32_t SimBackend::readRegister(uint32_t offset) {
+
+   if((offset >> 2) >= NREGS)
+      return 0;
+
+   return regs[offset >> 2].load(std::memory_order_acquire);
+}
+
+/**
+ * @brief Write a register
+ *
+ * Engine reacts as AXI DMA does: control writes start, stop or reset a channel,
+ * DMASR interrupt flags are cleared writing 1, TAILDESC (scatter-gather) or
+ * LENGTH (direct) writes start transfers.
+ *
+ * @param offset register offset
+ * @param value value
+ */
+void SimBackend::writeRegister(uint32_t offset, uint32_t value) {
+
+   if((offset >> 2) >= NREGS)
+      return;
+
+   std::lock_guard<std::mutex> lock(m);
+
+   unsigned ch = (offset >= DMACtrlBase::channelBase(DMACtrlBase::S2MM)) ? DMACtrlBase::S2MM : DMACtrlBase::MM2S;
+   uint32_t r = offset - DMACtrlBase::channelBase((DMACtrlBase::Channel) ch);
+   bool running = !(reg(ch, DMACtrlBase::DMASR) & SR_HALTED);
+
+   switch(r) {
+
+      case DMACtrlBase::DMACR:
+         control(ch, value);
+         break;
+
+      case DMACtrlBase::DMASR:
+         // IOC_Irq, Dly_Irq, Err_Irq are cleared writing 1, other bits are read only
+         setStatus(ch, 0, value & SR_IRQ);
+         break;
+
+      case DMACtrlBase::CURDESC:
+         setReg(ch, r, value);
+         eng[ch].cur = address(ch, DMACtrlBase::CURDESC);
+         eng[ch].done = UINT64_MAX;
+         break;
+
+      case DMACtrlBase::TAILDESC:
+         setReg(ch, r, value);
+         eng[ch].tail = address(ch, DMACtrlBase::TAILDESC);
+         if(sg && running)
+            start(ch);
+         break;
+
+      case DMACtrlBase::LENGTH:
+         setReg(ch, r, value);
+         if(!sg && running)
+            start(ch);
+         break;
+
+      default:
+         setReg(ch, r, value);
+   }
+
+   cv.notify_all();
+}
+
+/**
+ * @brief Simulated memory holds block descriptors
+ *
+ * @param ch channel index
+ * @param addr physical address of block descriptors
+ * @param size size of block descriptors area
+ *
+ * @return pointer to block descriptors (nullptr: area is outside of simulated memory)
+ */
+volatile uint32_t *SimBackend::mapDescriptors(unsigned ch, uint64_t addr, size_t size) {
+   return (volatile uint32_t *) memory(addr, size);
+}
+
+/**
+ * @brief Set and clear DMASR bits of a channel
+ *
+ * @param ch channel index
+ * @param set bits to set
+ * @param clear bits to clear
+ */
+void SimBackend::setStatus(unsigned ch, uint32_t set, uint32_t clear) {
+
+   std::atomic<uint32_t> &sr = regs[(DMACtrlBase::channelBase((DMACtrlBase::Channel) ch) + DMACtrlBase::DMASR) >> 2];
+   sr.store((sr.load(std::memory_order_relaxed) & ~clear) | set, std::memory_order_release);
+}
+
+/**
+ * @brief Soft reset: registers of both channels are cleared, channels are halted
+ */
+void SimBackend::resetChannels(void) {
+
+   for(unsigned ch : { DMACtrlBase::MM2S, DMACtrlBase::S2MM }) {
+      for(uint32_t r=0; r<0x30; r+=4)
+         setReg(ch, r, 0);
+      setReg(ch, DMACtrlBase::DMASR, SR_HALTED | (sg ? SR_SGINCLD : 0));
+      eng[ch] = Engine{};
+   }
+
+   packetLeft = 0;
+}
+
+/**
+ * @brief Handle DMACR write
+ *
+ * @param ch channel index
+ * @param value DMACR value
+ */
+void SimBackend::control(unsigned ch, uint32_t value) {
+
+   // soft reset affects both channels, reset bit is self clearing
+   if(value & CR_RESET) {
+      resetChannels();
+      return;
+   }
+
+   Engine &e = eng[ch];
+   bool wasRunning = reg(ch, DMACtrlBase::DMACR) & CR_RS;
+
+   setReg(ch, DMACtrlBase::DMACR, value);
+   e.threshold = std::max<uint32_t>((value >> 16) & 0xFF, 1);
+
+   if(!(value & CR_RS)) {
+      e.active = false;
+      setStatus(ch, SR_HALTED, 0);
+      return;
+   }
+
+   if(!wasRunning)
+      e.count = e.threshold;
+
+   setStatus(ch, (e.count << 16) | (e.active ? 0 : SR_IDLE), SR_THRESHOLD | SR_HALTED);
+}
+
+/**
+ * @brief Start transfers of a channel (TAILDESC or LENGTH written)
+ *
+ * MM2S transfers complete immediately, S2MM transfers are handed to engine thread.
+ *
+ * @param ch channel index
+ */
+void SimBackend::start(unsigned ch) {
+
+   Engine &e = eng[ch];
+
+   if(ch == DMACtrlBase::MM2S) {
+
+      if(sg) {
+         txRing();
+      } else if(memory(address(ch, DMACtrlBase::ADDRESS), reg(ch, DMACtrlBase::LENGTH) & BD_LENGTH_MASK) == nullptr) {
+         fail(ch, SR_DMADECERR);
+      } else {
+         setStatus(ch, SR_IOC_IRQ | SR_IDLE, 0);
+      }
+      return;
+   }
+
+   // an idle engine fetches again from the descriptor following the last completed one
+   if(!e.active) {
+      e.active = true;
+      e.due = std::max(e.due, std::chrono::steady_clock::now());
+   }
+
+   setStatus(ch, 0, SR_IDLE);
+}
+
+/**
+ * @brief Stop a channel on error
+ *
+ * @param ch channel index
+ * @param err DMASR error bit
+ */
+void SimBackend::fail(unsigned ch, uint32_t err) {
+
+   eng[ch].active = false;
+   setStatus(ch, err | SR_ERR_IRQ | SR_HALTED, SR_IDLE);
+}
+
+/**
+ * @brief Count a completed block descriptor: IOC_Irq is raised every IRQThreshold descriptors
+ *
+ * @param ch channel index
+ */
+void SimBackend::complete(unsigned ch) {
+
+   Engine &e = eng[ch];
+   uint32_t irq = 0;
+
+   if(--e.count == 0) {
+      e.count = e.threshold;
+      irq = SR_IOC_IRQ;
+   }
+
+   setStatus(ch, irq | (e.count << 16), SR_THRESHOLD);
+}
+
+/**
+ * @brief Write stream data (16 bit counter) into memory
+ *
+ * @param dst destination
+ * @param size size of data
+ */
+void SimBackend::fill(uint8_t *dst, uint32_t size) {
+
+   uint32_t i = 0;
+
+   if(!(streamPos & 1)) {
+      for(; i + 2 <= size; i += 2) {
+         uint16_t v = (uint16_t) ((streamPos + i) >> 1);
+         std::memcpy(dst + i, &v, 2);
+      }
+   }
+
+   for(; i < size; i++) {
+      uint64_t p = streamPos + i;
+      dst[i] = (uint8_t) ((p >> 1) >> ((p & 1) * 8));
+   }
+
+   streamPos += size;
+}
+
+/**
+ * @brief Get current time for completion timestamps
+ *
+ * @return steady_clock time (ns)
+ */
+int64_t SimBackend::timestamp(void) {
+   return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Get bytes of current packet fitting in a buffer
+ *
+ * @param size buffer size
+ * @param sof true if buffer starts a packet
+ * @param eof true if buffer ends a packet
+ *
+ * @return bytes written in buffer
+ */
+uint32_t SimBackend::packetBytes(uint32_t size, bool &sof, bool &eof) {
+
+   if(packetSize == 0) {
+      sof = eof = true;
+      return size;
+   }
+
+   if(packetLeft == 0)
+      packetLeft = packetSize;
+
+   sof = (packetLeft == packetSize);
+   uint32_t n = std::min(size, packetLeft);
+   packetLeft -= n;
+   eof = (packetLeft == 0);
+
+   return n;
+}
+
+/**
+ * @brief Complete MM2S block descriptors from CURDESC up to TAILDESC
+ */
+void SimBackend::txRing(void) {
+
+   unsigned ch = DMACtrlBase::MM2S;
+   Engine &e = eng[ch];
+
+   // an idle engine fetches again from the descriptor following the last completed one
+   for(size_t i=0; i < memsize / DESC_SIZE; i++) {
+
+      volatile uint32_t *bd = (volatile uint32_t *) memory(e.cur, DESC_SIZE);
+      if(bd == nullptr)
+         return fail(ch, SR_SGDECERR);
+
+      uint32_t len = bd[CONTROL>>2] & BD_LENGTH_MASK;
+      uint64_t bufaddr = ((uint64_t) bd[BUFFER_ADDRESS_MSB>>2] << 32) | bd[BUFFER_ADDRESS>>2];
+      if(memory(bufaddr, len) == nullptr)
+         return fail(ch, SR_DMADECERR);
+
+      // descriptor fields read before Cmplt is published (pairs with the controller's acquire load)
+      std::atomic_thread_fence(std::memory_order_release);
+      __atomic_store_n(&bd[STATUS>>2], BD_STATUS_CMPLT | len, __ATOMIC_RELAXED);
+
+      e.done = e.cur;
+      e.cur = ((uint64_t) bd[NXTDESC_MSB>>2] << 32) | bd[NXTDESC>>2];
+      complete(ch);
+
+      if(e.done == e.tail)
+         break;
+   }
+
+   setStatus(ch, SR_IDLE, 0);
+}
+
+/**
+ * @brief Write data of next S2MM block descriptor (or direct mode transfer)
+ */
+void SimBackend::rxStep(void) {
+
+   unsigned ch = DMACtrlBase::S2MM;
+   Engine &e = eng[ch];
+   bool sof, eof;
+   uint32_t n;
+
+   if(!sg) {
+
+      uint32_t len = reg(ch, DMACtrlBase::LENGTH) & BD_LENGTH_MASK;
+      uint8_t *dst = memory(address(ch, DMACtrlBase::ADDRESS), len);
+      if(dst == nullptr)
+         return fail(ch, SR_DMADECERR);
+
+      n = packetBytes(len, sof, eof);
+      fill(dst, n);
+      completion.store(timestamp(), std::memory_order_release);
+
+      // LENGTH reports received bytes
+      setReg(ch, DMACtrlBase::LENGTH, n);
+      e.active = false;
+      setStatus(ch, SR_IOC_IRQ | SR_IDLE, 0);
+
+   } else {
+
+      bool cyclic = reg(ch, DMACtrlBase::DMACR) & CR_CYCLIC;
+
+      volatile uint32_t *bd = (volatile uint32_t *) memory(e.cur, DESC_SIZE);
+      if(bd == nullptr)
+         return fail(ch, SR_SGDECERR);
+
+      // acquire: consumer reads of a released block are complete before it is overwritten
+      if(__atomic_load_n(&bd[STATUS>>2], __ATOMIC_ACQUIRE) & BD_STATUS_CMPLT) {
+         // a completed descriptor is fetched again: error in non-cyclic mode, data loss in cyclic mode
+         if(!cyclic)
+            return fail(ch, SR_SGINTERR);
+         overruns++;
+      }
+
+      uint32_t len = bd[CONTROL>>2] & BD_LENGTH_MASK;
+      uint64_t bufaddr = ((uint64_t) bd[BUFFER_ADDRESS_MSB>>2] << 32) | bd[BUFFER_ADDRESS>>2];
+      uint8_t *dst = memory(bufaddr, len);
+      if(dst == nullptr)
+         return fail(ch, SR_DMADECERR);
+
+      n = packetBytes(len, sof, eof);
+      fill(dst, n);
+
+      uint64_t ns = timestamp();
+      completion.store(ns, std::memory_order_release);
+      bd[APP0>>2] = (uint32_t) ns;
+      bd[APP1>>2] = (uint32_t) (ns >> 32);
+
+      // data is visible before Cmplt flag (pairs with the controller's acquire load of STATUS)
+      std::atomic_thread_fence(std::memory_order_release);
+      __atomic_store_n(&bd[STATUS>>2], BD_STATUS_CMPLT | (sof ? BD_STATUS_SOF : 0) | (eof ? BD_STATUS_EOF : 0) | n, __ATOMIC_RELAXED);
+
+      e.done = e.cur;
+      e.cur = ((uint64_t) bd[NXTDESC_MSB>>2] << 32) | bd[NXTDESC>>2];
+      complete(ch);
+
+      // non-cyclic ring: engine stops on tail descriptor
+      if(!cyclic && e.done == e.tail) {
+         e.active = false;
+         setStatus(ch, SR_IDLE, 0);
+      }
+   }
+
+   bytes += n;
+   transfers++;
+
+   if(rate > 0)
+      e.due += std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(n / rate));
+}
+
+/**
+ * @brief Engine thread: S2MM stream source
+ *
+ * Data of each transfer is written when due according to data rate; the lock is
+ * released between transfers so that register writes are handled meanwhile.
+ */
+void SimBackend::engineLoop(void) {
+
+   std::unique_lock<std::mutex> lock(m);
+   Engine &e = eng[DMACtrlBase::S2MM];
+
+   while(!stop) {
+
+      if(!e.active) {
+         cv.wait(lock);
+         continue;
+      }
+
+      if(rate > 0 && std::chrono::steady_clock::now() < e.due) {
+         cv.wait_until(lock, e.due);
+         continue;
+      }
+
+      rxStep();
+
+      lock.unlock();
+      if(rate == 0)
+         std::this_thread::yield();
+      lock.lock();
+   }
+}
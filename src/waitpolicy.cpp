@@ -0,0 +1,112 @@
+#include <thread>
+#include <algorithm>
+
+#include "waitpolicy.h"
+
+/**
+ * @brief Relax CPU during busy-poll (pause/yield instruction)
+ */
+void WaitPolicy::relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+   __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+   asm volatile("yield" ::: "memory");
+#endif
+}
+
+/**
+ * @brief AdaptiveWait constructor
+ *
+ * @param minwait minimum wait time (us)
+ * @param maxwait maximum wait time (us)
+ * @param minloop wait time is halved when a transfer completes in less idle steps
+ * @param maxloop wait time is doubled when a transfer completes in more idle steps
+ */
+AdaptiveWait::AdaptiveWait(uint32_t minwait, uint32_t maxwait, uint16_t minloop, uint16_t maxloop) {
+
+   minWait = minwait;
+   maxWait = maxwait;
+   minLoop = minloop;
+   maxLoop = maxloop;
+   curWait = (maxWait - minWait) / 2;
+}
+
+uint32_t AdaptiveWait::next(uint32_t nloops, uint32_t elapsed, uint32_t timeout) {
+   return (timeout == 0) ? curWait : minWait;
+}
+
+void AdaptiveWait::completed(uint32_t nloops, uint32_t elapsed, uint32_t timeout) {
+
+   if(timeout != 0)
+      return;
+
+   if(nloops > maxLoop) {
+      curWait *= 2;
+      if(curWait > maxWait) curWait = maxWait;
+   } else if(nloops < minLoop) {
+      curWait /= 2;
+      if(curWait < minWait) curWait = minWait;
+   }
+}
+
+uint32_t BusyPoll::next(uint32_t nloops, uint32_t elapsed, uint32_t timeout) {
+
+   if(yieldLoops && nloops && (nloops % yieldLoops) == 0)
+      std::this_thread::yield();
+
+   return 0;
+}
+
+uint32_t SpinSleep::next(uint32_t nloops, uint32_t elapsed, uint32_t timeout) {
+   return (elapsed < spinTime) ? 0 : sleepTime;
+}
+
+/**
+ * @brief EWMAWait constructor
+ *
+ * @param alpha weight of last measured interval
+ * @param margin busy-poll window (us) around expected completion
+ * @param minwait wait time (us) when completion is late
+ * @param maxwait maximum wait time (us)
+ */
+EWMAWait::EWMAWait(double alpha, uint32_t margin, uint32_t minwait, uint32_t maxwait) {
+
+   this->alpha = alpha;
+   this->margin = margin;
+   minWait = minwait;
+   maxWait = maxwait;
+   interval = 0;
+   started = false;
+}
+
+uint32_t EWMAWait::next(uint32_t nloops, uint32_t elapsed, uint32_t timeout) {
+
+   if(!started)
+      return minWait;
+
+   double since = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - last).count();
+   double remaining = interval - since;
+
+   // sleep until expected completion
+   if(remaining > margin)
+      return std::min((uint32_t) (remaining - margin), maxWait);
+
+   // busy-poll around expected completion
+   if(remaining > -((double) margin))
+      return 0;
+
+   // late completion
+   return minWait;
+}
+
+void EWMAWait::completed(uint32_t nloops, uint32_t elapsed, uint32_t timeout) {
+
+   auto now = std::chrono::steady_clock::now();
+
+   if(started) {
+      double sample = std::chrono::duration<double, std::micro>(now - last).count();
+      interval = (interval == 0) ? sample : alpha * sample + (1 - alpha) * interval;
+   } else started = true;
+
+   last = now;
+}
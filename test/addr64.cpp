@@ -0,0 +1,81 @@
+/**
+ * @file
+ * @brief Descriptor and buffer addresses above 4 GB
+ *
+ * Descriptors sit just below 4 GB and data buffers above it: a 32 bit core rejects
+ * the ring, a 40 bit core gets MSB words in descriptors and registers, and data
+ * lands at the 64 bit addresses (scatter-gather and direct mode).
+ */
+#include <memory>
+
+#include "testutil.h"
+
+#define MEMBASE   0xFFFF0000ull
+#define DESCSIZE  0x10000
+#define NDESC     8
+#define BLOCKSIZE 4096
+#define MEMSIZE   (DESCSIZE + NDESC * BLOCKSIZE)
+
+int main(void) {
+
+   DMACtrlT<SimBackend> dmac(std::make_unique<SimBackend>(MEMBASE, MEMSIZE));
+   SimBackend &sim = dmac.getBackend();
+   uint16_t counter = 0;
+   uint32_t n = 0;
+
+   dmac.setChannel(DMACtrl::S2MM);
+   dmac.reset();
+   dmac.setCyclic(false);
+
+   // 32 bit core: buffers above 4 GB are not reachable
+   CHECK(throws([&]() { dmac.initSG(MEMBASE, NDESC, BLOCKSIZE, MEMBASE + DESCSIZE); }));
+
+   dmac.setAddressWidth(40);
+   dmac.initSG(MEMBASE, NDESC, BLOCKSIZE, MEMBASE + DESCSIZE);
+   CHECK(dmac.getRegister(DMACtrl::regOffset<DMACtrl::S2MM>(DMACtrl::CURDESC_MSB)) == 0);
+
+   const volatile uint32_t *bd = (const volatile uint32_t *) sim.memory(MEMBASE, NDESC * DESC_SIZE);
+   for(uint32_t i=0; i<NDESC; i++) {
+      uint64_t bufaddr = MEMBASE + DESCSIZE + (uint64_t) BLOCKSIZE * i;
+      CHECK(dmac.getSGDescBufferAddress(i) == bufaddr);
+      CHECK(bd[(i * DESC_SIZE + BUFFER_ADDRESS) >> 2] == (uint32_t) bufaddr);
+      CHECK(bd[(i * DESC_SIZE + BUFFER_ADDRESS_MSB) >> 2] == 1);
+      CHECK(bd[(i * DESC_SIZE + NXTDESC_MSB) >> 2] == 0);
+   }
+
+   dmac.run();
+
+   const uint16_t *data = (const uint16_t *) sim.memory(MEMBASE + DESCSIZE, NDESC * BLOCKSIZE);
+   while(n < 2 * NDESC) {
+      CHECK(dmac.rx(100000));
+      DMACtrl::BlockRange range = dmac.getBlockRange();
+      CHECK(range.offset == BLOCKSIZE * range.first);
+      for(uint32_t i=0; i<(range.last - range.first + 1) * BLOCKSIZE / 2; i++)
+         CHECK(data[range.first * BLOCKSIZE / 2 + i] == counter++);
+      dmac.release(range);
+      n += range.last - range.first + 1;
+   }
+
+   // direct mode: destination address above 4 GB
+   DMACtrlT<SimBackend> direct(std::make_unique<SimBackend>(MEMBASE, MEMSIZE, false));
+   SimBackend &dsim = direct.getBackend();
+
+   direct.setChannel(DMACtrl::S2MM);
+   direct.reset();
+   CHECK(throws([&]() { direct.initDirect(BLOCKSIZE, MEMBASE + DESCSIZE); }));
+
+   direct.setAddressWidth(40);
+   direct.initDirect(BLOCKSIZE, MEMBASE + DESCSIZE);
+   CHECK(direct.getRegister(DMACtrl::regOffset<DMACtrl::S2MM>(DMACtrl::ADDRESS_MSB)) == 1);
+   CHECK(direct.getRegister(DMACtrl::regOffset<DMACtrl::S2MM>(DMACtrl::ADDRESS)) == (uint32_t) (MEMBASE + DESCSIZE));
+
+   direct.run();
+   CHECK(direct.rx(100000));
+   CHECK(dsim.getBytes() == BLOCKSIZE);
+
+   data = (const uint16_t *) dsim.memory(MEMBASE + DESCSIZE, BLOCKSIZE);
+   for(uint32_t i=0; i<BLOCKSIZE/2; i++)
+      CHECK(data[i] == i);
+
+   return 0;
+}
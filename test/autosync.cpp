@@ -0,0 +1,107 @@
+/**
+ * @file
+ * @brief Cache sync areas of automatic sync in cyclic and direct mode
+ *
+ * A received area is synced for CPU when it is returned; in cyclic mode the same
+ * area is given back to the device by the next rx()/tryComplete() (once), in direct
+ * mode by the next run(). Stream and dispatcher reject cyclic mode with automatic
+ * sync, since blocks would go back to the device while still in use.
+ */
+#include <memory>
+
+#include "dmastream.h"
+#include "dmadispatcher.h"
+#include "testutil.h"
+
+#define DESCSIZE  0x1000
+#define NDESC     8
+#define BLOCKSIZE 4096
+#define BUFSIZE   (DESCSIZE + NDESC * BLOCKSIZE)
+
+int main(void) {
+
+   FakeUdmabuf udmabuf;
+   DMABuffer dbuf;
+   BlockView view, last;
+
+   udmabuf.add("udmabuf0", TEST_MEMBASE, BUFSIZE);
+   CHECK(udmabuf.open(dbuf, "udmabuf0", true));
+
+   auto attr = [&](const char *name) { return udmabuf.attr("udmabuf0", name); };
+
+   {
+      DMACtrlT<SimBackend> dmac(std::make_unique<SimBackend>((uint8_t *) dbuf.buf, TEST_MEMBASE, BUFSIZE));
+      SimBackend &sim = dmac.getBackend();
+
+      dmac.setChannel(DMACtrl::S2MM);
+      dmac.reset();
+      dmac.initSG(TEST_MEMBASE, NDESC, BLOCKSIZE, TEST_MEMBASE + DESCSIZE);
+
+      // sync needs a bound buffer
+      CHECK(throws([&]() { dmac.setAutoSync(true); }));
+      dmac.setBuffer(dbuf);
+      dmac.setAutoSync(true);
+      dmac.run();
+
+      CHECK(dmac.rx(view, 100000));
+      CHECK(attr("sync_for_cpu") == "1");
+      CHECK(attr("sync_offset") == std::to_string(view.offset));
+      CHECK(attr("sync_size") == std::to_string(view.size()));
+
+      // engine stops feeding data: take blocks already received, last returned
+      // area goes back to device on the call finding no data
+      sim.setRate(1);
+      last = view;
+      for(;;) {
+         udmabuf.clear("udmabuf0", "sync_for_device");
+         udmabuf.clear("udmabuf0", "sync_for_cpu");
+         if(!dmac.tryComplete(view))
+            break;
+         last = view;
+      }
+
+      CHECK(attr("sync_for_device") == "1");
+      CHECK(attr("sync_for_cpu") == "");
+      CHECK(attr("sync_offset") == std::to_string(last.offset));
+      CHECK(attr("sync_size") == std::to_string(last.size()));
+
+      // once
+      udmabuf.clear("udmabuf0", "sync_for_device");
+      CHECK(!dmac.tryComplete(view));
+      CHECK(attr("sync_for_device") == "");
+
+      // consumers holding blocks reject cyclic mode with automatic sync
+      DMAStreamT<SimBackend> stream(dmac);
+      CHECK(throws([&]() { stream.start(); }));
+
+      DMADispatcherT<SimBackend, int> disp(dmac, 1,
+         [](const DispatchBlock &) { return 0; }, [](const DispatchBlock &, int &) { });
+      CHECK(throws([&]() { disp.start(); }));
+   }
+
+   // direct mode: block is given back to device by next run()
+   DMACtrlT<SimBackend> dmac(std::make_unique<SimBackend>((uint8_t *) dbuf.buf, TEST_MEMBASE, BUFSIZE, false));
+
+   dmac.setChannel(DMACtrl::S2MM);
+   dmac.reset();
+   dmac.initDirect(BLOCKSIZE, TEST_MEMBASE + DESCSIZE);
+   dmac.setBuffer(dbuf);
+   dmac.setAutoSync(true);
+
+   for(int i=0; i<2; i++) {
+
+      udmabuf.clear("udmabuf0", "sync_for_device");
+      dmac.run();
+      CHECK(attr("sync_for_device") == "1");
+      CHECK(attr("sync_offset") == std::to_string(DESCSIZE));
+      CHECK(attr("sync_size") == std::to_string(BLOCKSIZE));
+
+      udmabuf.clear("udmabuf0", "sync_for_cpu");
+      CHECK(dmac.rx(view, 100000));
+      CHECK(attr("sync_for_cpu") == "1");
+      CHECK(attr("sync_offset") == std::to_string(DESCSIZE));
+      CHECK(view.size() == BLOCKSIZE);
+   }
+
+   return 0;
+}
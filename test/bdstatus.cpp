@@ -0,0 +1,75 @@
+/**
+ * @file
+ * @brief Transferred bytes and errors reported by descriptor STATUS words
+ *
+ * Packets shorter than a block leave the last descriptor partially filled: lengths,
+ * range size and bytes follow the STATUS words. A descriptor error (STATUS error
+ * bits) and a channel error (DMASR error bits, engine halted) are reported by rx().
+ */
+#include <chrono>
+
+#include "testutil.h"
+
+#define DESCSIZE  0x1000
+#define NDESC     8
+#define BLOCKSIZE 4096
+#define PACKET    6000
+
+int main(void) {
+
+   DMACtrlT<SimBackend> dmac = simController(DESCSIZE + NDESC * BLOCKSIZE);
+   SimBackend &sim = dmac.getBackend();
+   DMACtrl::BlockRange range;
+   uint32_t n = 0;
+
+   dmac.setChannel(DMACtrl::S2MM);
+   dmac.reset();
+   dmac.setCyclic(false);
+   dmac.initSG(TEST_MEMBASE, NDESC, BLOCKSIZE, TEST_MEMBASE + DESCSIZE);
+
+   // a packet fills a block and PACKET - BLOCKSIZE bytes of the next one
+   sim.setPacketSize(PACKET);
+   dmac.run();
+
+   while(n < NDESC) {
+      CHECK(dmac.rx(100000));
+      range = dmac.getBlockRange();
+
+      uint32_t bytes = 0;
+      for(uint32_t i=range.first; i<=range.last; i++) {
+         CHECK(dmac.getDescLength(i) == ((i & 1) ? PACKET - BLOCKSIZE : BLOCKSIZE));
+         bytes += dmac.getDescLength(i);
+      }
+      CHECK(range.bytes == bytes);
+      CHECK(range.size == BLOCKSIZE * (range.last - range.first) + dmac.getDescLength(range.last));
+
+      dmac.release(range);
+      n += range.last - range.first + 1;
+   }
+
+   // descriptor completed with an error (nothing is received at 1 byte/s)
+   dmac.halt();
+   sim.setPacketSize(0);
+   sim.setRate(1);
+   dmac.initSG(TEST_MEMBASE, NDESC, BLOCKSIZE, TEST_MEMBASE + DESCSIZE);
+   dmac.run();
+   CHECK(!dmac.tryComplete(range));
+
+   *(volatile uint32_t *) sim.memory(TEST_MEMBASE + STATUS, 4) = BD_STATUS_CMPLT | (1u << 29) | BLOCKSIZE;
+   CHECK(throws([&]() { dmac.tryComplete(range); }));
+
+   // buffer address outside of memory: engine halts with DMASR decode error
+   dmac.halt();
+   sim.setRate(0);
+   dmac.initSG(TEST_MEMBASE, NDESC, BLOCKSIZE, TEST_MEMBASE + DESCSIZE);
+   *(volatile uint32_t *) sim.memory(TEST_MEMBASE + BUFFER_ADDRESS, 4) = 0;
+   dmac.run();
+
+   auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+   while(!(dmac.getRegister(DMACtrl::regOffset<DMACtrl::S2MM>(DMACtrl::DMASR)) & 1) && std::chrono::steady_clock::now() < deadline)
+      ;
+   CHECK(dmac.getRegister(DMACtrl::regOffset<DMACtrl::S2MM>(DMACtrl::DMASR)) & DMASR_ERR);
+   CHECK(throws([&]() { dmac.rx(100000); }));
+
+   return 0;
+}
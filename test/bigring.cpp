@@ -0,0 +1,59 @@
+/**
+ * @file
+ * @brief Ring of more descriptors than the 8 bit IRQThreshold field counts
+ *
+ * IRQThreshold is clamped to 255 and completion is tracked with STATUS flags:
+ * a cyclic buffer transfer returns the whole ring, a non-cyclic ring hands out
+ * descriptors beyond index 255 in order and without data loss.
+ */
+#include "testutil.h"
+
+#define NDESC     600
+#define DESCSIZE  0x10000
+#define BLOCKSIZE 256
+#define LAPS      2
+
+int main(void) {
+
+   DMACtrlT<SimBackend> dmac = simController(DESCSIZE + NDESC * BLOCKSIZE);
+   SimBackend &sim = dmac.getBackend();
+   uint32_t n = 0;
+
+   dmac.setChannel(DMACtrl::S2MM);
+   dmac.reset();
+   dmac.initSG(TEST_MEMBASE, NDESC, BLOCKSIZE, TEST_MEMBASE + DESCSIZE);
+   CHECK(dmac.getSGDescBufferAddress(NDESC-1) == TEST_MEMBASE + DESCSIZE + BLOCKSIZE * (NDESC-1));
+
+   // cyclic mode: buffer transfers cover all descriptors
+   dmac.run();
+   CHECK(((dmac.getRegister(DMACtrl::regOffset<DMACtrl::S2MM>(DMACtrl::DMACR)) >> 16) & 0xFF) == 255);
+
+   for(int i=0; i<2; i++) {
+      CHECK(dmac.rx(1000000));
+      DMACtrl::BlockRange range = dmac.getBlockRange();
+      CHECK(range.first == 0 && range.last == NDESC-1);
+      CHECK(range.bytes == NDESC * BLOCKSIZE);
+   }
+
+   // non-cyclic mode: every descriptor is handed out once per lap
+   dmac.halt();
+   dmac.setCyclic(false);
+   dmac.initSG(TEST_MEMBASE, NDESC, BLOCKSIZE, TEST_MEMBASE + DESCSIZE);
+
+   // stream data continues from where the halted engine stopped
+   const uint16_t *data = (const uint16_t *) sim.memory(TEST_MEMBASE + DESCSIZE, NDESC * BLOCKSIZE);
+   uint16_t counter = (uint16_t) (sim.getBytes() / 2);
+   dmac.run();
+
+   while(n < LAPS * NDESC) {
+      CHECK(dmac.rx(1000000));
+      DMACtrl::BlockRange range = dmac.getBlockRange();
+      CHECK(range.first == n % NDESC);
+      for(uint32_t i=0; i<(range.last - range.first + 1) * BLOCKSIZE / 2; i++)
+         CHECK(data[range.first * BLOCKSIZE / 2 + i] == counter++);
+      dmac.release(range);
+      n += range.last - range.first + 1;
+   }
+
+   return 0;
+}
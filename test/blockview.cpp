@@ -0,0 +1,48 @@
+/**
+ * @file
+ * @brief Views of a ring placed after the descriptors in a DMA buffer
+ *
+ * Block descriptors fill the start of the buffer and the ring target address
+ * follows them: view offsets are relative to the buffer, and releasing a view
+ * with automatic cache sync gives back the same buffer area it was synced for CPU.
+ */
+#include "testutil.h"
+
+#define DESCSIZE  0x1000
+#define NDESC     8
+#define BLOCKSIZE 4096
+#define BUFSIZE   (DESCSIZE + NDESC * BLOCKSIZE)
+
+int main(void) {
+
+   FakeUdmabuf udmabuf;
+   DMABuffer dbuf;
+   DMACtrlT<SimBackend> dmac = simController(BUFSIZE);
+   BlockView view;
+
+   udmabuf.add("udmabuf0", TEST_MEMBASE, BUFSIZE);
+   CHECK(udmabuf.open(dbuf, "udmabuf0", true));
+
+   dmac.setChannel(DMACtrl::S2MM);
+   dmac.reset();
+   dmac.setCyclic(false);
+   dmac.initSG(TEST_MEMBASE, NDESC, BLOCKSIZE, TEST_MEMBASE + DESCSIZE);
+   dmac.setBuffer(dbuf);
+   dmac.setAutoSync(true);
+   dmac.run();
+
+   for(int i=0; i<2*NDESC; i++) {
+
+      CHECK(dmac.rx(view, 100000));
+      CHECK(view.offset == DESCSIZE + BLOCKSIZE * view.first);
+      CHECK(view.data() == (const std::byte *) dbuf.buf + view.offset);
+      CHECK(udmabuf.attr("udmabuf0", "sync_offset") == std::to_string(view.offset));
+
+      udmabuf.clear("udmabuf0", "sync_for_device");
+      dmac.release(view);
+      CHECK(udmabuf.attr("udmabuf0", "sync_offset") == std::to_string(view.offset));
+      CHECK(udmabuf.attr("udmabuf0", "sync_for_device") == "1");
+   }
+
+   return 0;
+}
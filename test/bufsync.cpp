@@ -0,0 +1,35 @@
+/**
+ * @file
+ * @brief Cache sync falls back from ioctl to sysfs on a fake udmabuf
+ *
+ * Plain files stand in for the device node (ioctl fails with ENOTTY) and for
+ * the sysfs class attributes: the first sync selects the sysfs interface and
+ * writes the exact area; an area past the buffer end is rejected.
+ */
+#include "testutil.h"
+
+#define BUFSIZE   65536
+
+int main(void) {
+
+   FakeUdmabuf udmabuf;
+   DMABuffer dbuf;
+
+   udmabuf.add("udmabuf0", 0x30000000, BUFSIZE);
+
+   CHECK(udmabuf.open(dbuf, "udmabuf0", true));
+   CHECK(dbuf.getPhysicalAddress() == 0x30000000);
+   CHECK(dbuf.getBufferSize() == BUFSIZE);
+   CHECK(dbuf.getSyncMethod() == DMABuffer::SYNC_AUTO);
+
+   CHECK(dbuf.syncForCpu(0x100, 100));
+   CHECK(dbuf.getSyncMethod() == DMABuffer::SYNC_SYSFS);
+   CHECK(udmabuf.attr("udmabuf0", "sync_offset") == "256");
+   CHECK(udmabuf.attr("udmabuf0", "sync_size") == "100");
+   CHECK(udmabuf.attr("udmabuf0", "sync_direction") == "2");
+   CHECK(udmabuf.attr("udmabuf0", "sync_for_cpu") == "1");
+
+   CHECK(!dbuf.syncForDevice(BUFSIZE - 8, 16));
+
+   return 0;
+}
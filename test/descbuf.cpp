@@ -0,0 +1,73 @@
+/**
+ * @file
+ * @brief Descriptor ring placed at the start of a cached DMA buffer
+ *
+ * The simulated engine works on the buffer mapping itself: descriptors written
+ * by the controller link the ring inside the buffer, descriptor cache sync goes
+ * through the udmabuf attributes, and data received after the descriptors is
+ * read through views.
+ */
+#include <memory>
+
+#include "testutil.h"
+
+#define DESCSIZE  0x1000
+#define NDESC     8
+#define BLOCKSIZE 4096
+#define BUFSIZE   (DESCSIZE + NDESC * BLOCKSIZE)
+
+int main(void) {
+
+   FakeUdmabuf udmabuf;
+   DMABuffer dbuf;
+   BlockView view;
+   uint16_t counter = 0;
+   uint32_t n = 0;
+
+   udmabuf.add("udmabuf0", TEST_MEMBASE, BUFSIZE);
+   CHECK(udmabuf.open(dbuf, "udmabuf0", true));
+
+   DMACtrlT<SimBackend> dmac(std::make_unique<SimBackend>((uint8_t *) dbuf.buf, TEST_MEMBASE, BUFSIZE));
+
+   dmac.setChannel(DMACtrl::S2MM);
+   dmac.reset();
+   dmac.setCyclic(false);
+
+   // descriptors must fit in the buffer
+   CHECK(throws([&]() { dmac.initSG(dbuf, BUFSIZE / DESC_SIZE + 1, BLOCKSIZE, TEST_MEMBASE + DESCSIZE); }));
+
+   dmac.initSG(dbuf, NDESC, BLOCKSIZE, TEST_MEMBASE + DESCSIZE);
+
+   // written descriptors are given to device
+   CHECK(udmabuf.attr("udmabuf0", "sync_offset") == "0");
+   CHECK(udmabuf.attr("udmabuf0", "sync_size") == std::to_string(NDESC * DESC_SIZE));
+   CHECK(udmabuf.attr("udmabuf0", "sync_for_device") == "1");
+
+   const volatile uint32_t *bd = (const volatile uint32_t *) dbuf.buf;
+   for(uint32_t i=0; i<NDESC; i++) {
+      CHECK(bd[(i * DESC_SIZE + NXTDESC) >> 2] == TEST_MEMBASE + DESC_SIZE * ((i + 1) % NDESC));
+      CHECK(bd[(i * DESC_SIZE + BUFFER_ADDRESS) >> 2] == TEST_MEMBASE + DESCSIZE + BLOCKSIZE * i);
+   }
+
+   dmac.setBuffer(dbuf);
+   dmac.run();
+
+   while(n < 2 * NDESC) {
+
+      // descriptors are synced for CPU before STATUS words are scanned
+      udmabuf.clear("udmabuf0", "sync_for_cpu");
+      CHECK(dmac.rx(view, 100000));
+      CHECK(udmabuf.attr("udmabuf0", "sync_for_cpu") == "1");
+
+      CHECK(view.first == n % NDESC);
+      CHECK(view.offset == DESCSIZE + BLOCKSIZE * view.first);
+      CHECK(view.data() == (const std::byte *) dbuf.buf + view.offset);
+      for(uint16_t v : view.as<uint16_t>())
+         CHECK(v == counter++);
+
+      dmac.release(view);
+      n += view.last - view.first + 1;
+   }
+
+   return 0;
+}
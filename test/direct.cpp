@@ -0,0 +1,50 @@
+/**
+ * @file
+ * @brief Direct mode completion is reported once per run()
+ *
+ * On the simulated core a finished direct transfer is returned by tryComplete()
+ * and rx() once; both report no data (rx() without waiting, even with infinite
+ * timeout) until run() starts the next transfer, which gets the next sequence number.
+ */
+#include "testutil.h"
+
+#define BLOCKSIZE 4096
+
+int main(void) {
+
+   DMACtrlT<SimBackend> dmac = simController(BLOCKSIZE, false);
+   DMACtrl::BlockRange range;
+
+   dmac.setChannel(DMACtrl::S2MM);
+   dmac.reset();
+   dmac.initDirect(BLOCKSIZE, TEST_MEMBASE);
+
+   // nothing started yet
+   CHECK(!dmac.tryComplete(range));
+
+   dmac.run();
+   CHECK(dmac.rx(100000));
+   CHECK(dmac.getBlockRange().bytes == BLOCKSIZE);
+
+   // same transfer is not reported again
+   CHECK(!dmac.tryComplete(range));
+   CHECK(!dmac.rx(1000));
+   CHECK(!dmac.rx());
+
+   // sequence numbers increase across run() calls
+   dmac.run();
+   CHECK(dmac.rx(100000));
+   CHECK(dmac.getBlockSequence() == 1);
+   CHECK(!dmac.tryComplete(range));
+
+   // wait for idle, then get the transfer (as before completion was reported once)
+   for(int i=0; i<2; i++) {
+      dmac.run();
+      while(!dmac.isIdle())
+         ;
+      CHECK(dmac.rx());
+   }
+   CHECK(dmac.getBlockSequence() == 3);
+
+   return 0;
+}
@@ -0,0 +1,75 @@
+/**
+ * @file
+ * @brief Packet splitting with RXSOF/RXEOF flags in packet mode
+ *
+ * Packets span three blocks, so one of them crosses the ring end: transfers end
+ * on packet boundaries except at ring end, where the packet is reported with eof
+ * cleared and completed by the next transfer with sof cleared.
+ */
+#include <vector>
+
+#include "testutil.h"
+
+#define DESCSIZE  0x1000
+#define NDESC     8
+#define BLOCKSIZE 4096
+#define PACKET    (3 * BLOCKSIZE)
+#define NPACKETS  5
+
+int main(void) {
+
+   DMACtrlT<SimBackend> dmac = simController(DESCSIZE + NDESC * BLOCKSIZE);
+   SimBackend &sim = dmac.getBackend();
+   DMACtrl::BlockRange range;
+   uint32_t complete = 0, wrapped = 0, open = 0;
+   bool inPacket = false;
+
+   dmac.setChannel(DMACtrl::S2MM);
+   dmac.reset();
+   dmac.setCyclic(false);
+   dmac.setPacketMode(true);
+   dmac.initSG(TEST_MEMBASE, NDESC, BLOCKSIZE, TEST_MEMBASE + DESCSIZE);
+   sim.setPacketSize(PACKET);
+   dmac.run();
+
+   while(complete < NPACKETS) {
+
+      CHECK(dmac.rx(100000));
+      range = dmac.getBlockRange();
+      const std::vector<Packet> &packets = dmac.getPackets();
+      CHECK(!packets.empty());
+
+      for(const Packet &p : packets) {
+
+         if(p.sof) {
+            CHECK(!inPacket);
+            inPacket = true;
+            open = 0;
+         } else {
+            // only a packet continued from previous transfer has no start of frame
+            CHECK(inPacket && &p == &packets[0] && p.first == 0);
+            wrapped++;
+         }
+
+         CHECK(p.offset == BLOCKSIZE * (p.first - range.first));
+         open += p.size;
+
+         if(p.eof) {
+            CHECK(open == PACKET);
+            inPacket = false;
+            complete++;
+         } else {
+            CHECK(p.last == range.last);
+         }
+      }
+
+      // transfers end on a packet boundary, except at ring end
+      CHECK(!inPacket || range.last == NDESC-1);
+
+      dmac.release(range);
+   }
+
+   CHECK(wrapped == 1);
+
+   return 0;
+}
@@ -0,0 +1,86 @@
+/**
+ * @file
+ * @brief Ring spanning several DMA buffers
+ *
+ * Three buffers of different sizes, not contiguous in memory, hold the ring
+ * blocks: transfers never cross a segment, views point into the segment buffer
+ * and stream data continues across segments and laps.
+ */
+#include <vector>
+
+#include "testutil.h"
+
+#define DESCSIZE  0x1000
+#define BLOCKSIZE 4096
+#define NSEG      3
+#define NDESC     9
+
+int main(void) {
+
+   const uint32_t count[NSEG] = { 3, 2, 4 };
+   uint64_t physaddr[NSEG];
+   uint32_t first[NSEG];
+
+   FakeUdmabuf udmabuf;
+   DMABuffer dbuf[NSEG], small;
+   std::vector<DMABuffer *> bufs;
+   DMACtrlT<SimBackend> dmac = simController(DESCSIZE + (NDESC + NSEG) * BLOCKSIZE);
+   SimBackend &sim = dmac.getBackend();
+   BlockView view;
+   uint16_t counter = 0;
+   uint32_t n = 0;
+
+   // a block gap between buffers
+   uint64_t addr = TEST_MEMBASE + DESCSIZE;
+   for(int k=0, desc=0; k<NSEG; k++) {
+      std::string name = "udmabuf" + std::to_string(k);
+      physaddr[k] = addr;
+      first[k] = desc;
+      udmabuf.add(name, addr, count[k] * BLOCKSIZE);
+      CHECK(udmabuf.open(dbuf[k], name, false));
+      bufs.push_back(&dbuf[k]);
+      addr += (count[k] + 1) * BLOCKSIZE;
+      desc += count[k];
+   }
+
+   dmac.setChannel(DMACtrl::S2MM);
+   dmac.reset();
+   dmac.setCyclic(false);
+
+   // a buffer can not hold a single block
+   udmabuf.add("small", addr, BLOCKSIZE / 2);
+   CHECK(udmabuf.open(small, "small", false));
+   CHECK(throws([&]() { dmac.initSG(TEST_MEMBASE, BLOCKSIZE, std::vector<DMABuffer *>{ &dbuf[0], &small }); }));
+
+   dmac.initSG(TEST_MEMBASE, BLOCKSIZE, bufs);
+   for(int k=0; k<NSEG; k++)
+      for(uint32_t i=0; i<count[k]; i++)
+         CHECK(dmac.getSGDescBufferAddress(first[k] + i) == physaddr[k] + BLOCKSIZE * i);
+
+   dmac.run();
+
+   while(n < 2 * NDESC) {
+
+      CHECK(dmac.rx(view, 100000));
+
+      int k = NSEG - 1;
+      while(view.first < first[k])
+         k--;
+
+      CHECK(view.first == n % NDESC);
+      CHECK(view.segment == (uint32_t) k);
+      CHECK(view.last < first[k] + count[k]);
+      CHECK(view.offset == BLOCKSIZE * (view.first - first[k]));
+      CHECK(view.data() == (const std::byte *) dbuf[k].buf + view.offset);
+      CHECK(dmac.getBlockRange().offset == view.offset);
+
+      const uint16_t *data = (const uint16_t *) sim.memory(physaddr[k] + view.offset, view.size());
+      for(size_t i=0; i<view.size()/2; i++)
+         CHECK(data[i] == counter++);
+
+      dmac.release(view);
+      n += view.last - view.first + 1;
+   }
+
+   return 0;
+}
@@ -0,0 +1,128 @@
+/**
+ * @file
+ * @brief DMAStream hand-off between acquisition thread and consumer
+ *
+ * Non-cyclic mode: transfers come out in order with continuous data, a full queue
+ * stalls acquisition (nothing is dropped) until the consumer pops and releases.
+ * Cyclic mode: transfers finding the queue full are dropped.
+ * An engine error stops the acquisition thread: a release() that can no longer
+ * be queued reports it.
+ */
+#include <thread>
+#include <chrono>
+
+#include "dmastream.h"
+#include "testutil.h"
+
+#define DESCSIZE  0x1000
+#define NDESC     8
+#define BLOCKSIZE 4096
+#define CAPACITY  2
+
+/* Wait for a condition with a deadline */
+template<typename F>
+static bool waitFor(F cond) {
+   auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+   while(!cond() && std::chrono::steady_clock::now() < deadline)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+   return cond();
+}
+
+int main(void) {
+
+   {
+      DMACtrlT<SimBackend> dmac = simController(DESCSIZE + NDESC * BLOCKSIZE);
+      SimBackend &sim = dmac.getBackend();
+      const uint16_t *data = (const uint16_t *) sim.memory(TEST_MEMBASE + DESCSIZE, NDESC * BLOCKSIZE);
+      uint16_t counter = 0;
+      uint32_t n = 0;
+      uint64_t popped = 0;
+      StreamBlock block;
+
+      // about one block per rx()
+      sim.setRate(1000 * BLOCKSIZE);
+
+      dmac.setChannel(DMACtrl::S2MM);
+      dmac.reset();
+      dmac.setCyclic(false);
+      dmac.initSG(TEST_MEMBASE, NDESC, BLOCKSIZE, TEST_MEMBASE + DESCSIZE);
+      dmac.run();
+
+      DMAStreamT<SimBackend> stream(dmac, CAPACITY);
+      stream.start();
+
+      // consumer not popping: acquisition waits on full queue
+      CHECK(waitFor([&]() { return stream.getStats().fullWaits > 0; }));
+      CHECK(stream.size() == CAPACITY);
+
+      while(n < 4 * NDESC) {
+         CHECK(stream.pop(block, 1000000));
+         CHECK(block.sequence == popped++);
+         CHECK(block.range.first == n % NDESC);
+         for(uint32_t i=0; i<(block.range.last - block.range.first + 1) * BLOCKSIZE / 2; i++)
+            CHECK(data[block.range.first * BLOCKSIZE / 2 + i] == counter++);
+         stream.release(block);
+         n += block.range.last - block.range.first + 1;
+      }
+
+      stream.stop();
+      StreamStats st = stream.getStats();
+      CHECK(st.dropped == 0);
+      CHECK(st.highWater == CAPACITY);
+      CHECK(st.published == popped + stream.size());
+   }
+
+   {
+      DMACtrlT<SimBackend> dmac = simController(DESCSIZE + NDESC * BLOCKSIZE);
+      StreamBlock block;
+
+      dmac.setChannel(DMACtrl::S2MM);
+      dmac.reset();
+      dmac.initSG(TEST_MEMBASE, NDESC, BLOCKSIZE, TEST_MEMBASE + DESCSIZE);
+      dmac.run();
+
+      DMAStreamT<SimBackend> stream(dmac, CAPACITY);
+      stream.start();
+
+      // cyclic mode: transfers overflowing the queue are dropped, the queued ones kept
+      CHECK(waitFor([&]() { return stream.getStats().dropped > 0; }));
+      stream.stop();
+
+      StreamStats st = stream.getStats();
+      CHECK(st.published == CAPACITY && st.fullWaits == 0);
+
+      CHECK(stream.pop(block, 1000));
+      uint64_t sequence = block.sequence;
+      CHECK(stream.pop(block, 1000));
+      CHECK(block.sequence == sequence + 1);
+      CHECK(!stream.pop(block, 1000));
+   }
+
+   DMACtrlT<SimBackend> dmac = simController(DESCSIZE + NDESC * BLOCKSIZE);
+   SimBackend &sim = dmac.getBackend();
+   StreamBlock block;
+
+   dmac.setChannel(DMACtrl::S2MM);
+   dmac.reset();
+   dmac.setCyclic(false);
+   dmac.initSG(TEST_MEMBASE, NDESC, BLOCKSIZE, TEST_MEMBASE + DESCSIZE);
+
+   // second descriptor points outside memory: engine halts with a decode error
+   *(uint32_t *) sim.memory(TEST_MEMBASE + DESC_SIZE + BUFFER_ADDRESS, 4) = 0;
+   dmac.run();
+
+   DMAStreamT<SimBackend> stream(dmac, 1);
+   stream.start();
+
+   CHECK(stream.pop(block, 1000000));
+   CHECK(block.range.first == 0 && block.range.last == 0);
+
+   CHECK(waitFor([&]() { return !stream.isRunning(); }));
+
+   // first release fills the queue, next one is lost and reports the error
+   stream.release(block);
+   CHECK(throws([&]() { stream.release(block); }));
+   CHECK(!stream.pop(block, 1000));
+
+   return 0;
+}
@@ -0,0 +1,134 @@
+/**
+ * @file
+ * @brief Helpers shared by tests: checks, simulated controller, fake udmabuf
+ */
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <filesystem>
+#include <cstdlib>
+
+#include "dmactrl.h"
+#include "dmabuffer.h"
+#include "simbackend.h"
+
+/** Physical address of simulated memory */
+#define TEST_MEMBASE    0x10000000
+
+/** Report failed condition with its line and make the test fail (returns 1) */
+#define CHECK(cond) do { if(!(cond)) { std::cout << "E: " << __LINE__ << ": " #cond << std::endl; return 1; } } while(0)
+
+/**
+ * @brief Get true if a call throws runtime_error
+ */
+template<typename F>
+inline bool throws(F f) {
+   try {
+      f();
+   } catch(const std::runtime_error &) {
+      return true;
+   }
+   return false;
+}
+
+/**
+ * @brief Create a controller on a simulated core
+ *
+ * @param memsize size of simulated memory at TEST_MEMBASE
+ * @param sg true: scatter-gather engine included, false: direct mode
+ */
+inline DMACtrlT<SimBackend> simController(size_t memsize, bool sg = true) {
+   return DMACtrlT<SimBackend>(std::make_unique<SimBackend>(TEST_MEMBASE, memsize, sg));
+}
+
+/**
+ * @brief udmabuf driver stand-in made of plain files in a temporary directory
+ *
+ * Device nodes are regular files (mapped by DMABuffer::open(), ioctl fails with ENOTTY)
+ * and sysfs class attributes are plain files, so written sync areas can be read back.
+ */
+class FakeUdmabuf {
+
+public:
+   /** Create temporary device and sysfs class directories */
+   FakeUdmabuf(void) {
+
+      char tmpl[] = "/tmp/axidma_udmabufXXXXXX";
+      if(mkdtemp(tmpl) == nullptr)
+         throw std::runtime_error(std::string(__func__) + ": can not create fake udmabuf");
+
+      root = tmpl;
+      std::filesystem::create_directories(root / "dev");
+      std::filesystem::create_directories(root / "class");
+   };
+
+   /** Remove temporary directories */
+   ~FakeUdmabuf(void) { std::filesystem::remove_all(root); };
+
+   FakeUdmabuf(const FakeUdmabuf &) = delete;
+   FakeUdmabuf &operator=(const FakeUdmabuf &) = delete;
+
+   /** Add a buffer of size bytes at physical address physaddr */
+   void add(std::string name, uint64_t physaddr, size_t size) {
+
+      std::filesystem::path cls = root / "class" / name;
+      std::filesystem::create_directories(cls);
+
+      write(root / "dev" / name, "");
+      std::filesystem::resize_file(root / "dev" / name, size);
+      write(cls / "phys_addr", "0x" + hex(physaddr));
+      write(cls / "size", std::to_string(size));
+      for(const char *attr : { "sync_offset", "sync_size", "sync_direction", "sync_for_cpu", "sync_for_device", "sync_mode" })
+         write(cls / attr, "");
+   };
+
+   /** Open a buffer added by add() */
+   bool open(DMABuffer &dbuf, std::string name, bool cache_on) {
+      dbuf.setDeviceDirs((root / "dev").string(), (root / "class").string());
+      return dbuf.open(name, cache_on);
+   };
+
+   /**
+   * @brief Read a sysfs class attribute of a buffer
+   *
+   * The file is emptied once read (DMABuffer rewrites attributes in place at offset 0,
+   * a shorter value would leave trailing characters): the last value is returned until
+   * a new one is written.
+   */
+   std::string attr(std::string name, std::string attr) {
+
+      std::filesystem::path p = root / "class" / name / attr;
+      std::string value;
+
+      std::ifstream(p) >> value;
+      if(value.empty())
+         return values[p];
+
+      write(p, "");
+      values[p] = value;
+      return value;
+   };
+
+   /** Clear a sysfs class attribute of a buffer (e.g. to check that it is written again) */
+   void clear(std::string name, std::string attr) {
+      std::filesystem::path p = root / "class" / name / attr;
+      write(p, "");
+      values.erase(p);
+   };
+
+private:
+   std::filesystem::path root;
+   std::map<std::filesystem::path, std::string> values;
+
+   static void write(const std::filesystem::path &p, const std::string &value) { std::ofstream(p) << value; };
+   static std::string hex(uint64_t value) {
+      char s[20];
+      snprintf(s, sizeof(s), "%llx", (unsigned long long) value);
+      return s;
+   };
+};
@@ -0,0 +1,72 @@
+/**
+ * @file
+ * @brief MM2S errors are reported instead of waiting forever or sending out of range data
+ *
+ * On the simulated core a direct mode transfer reading outside memory halts the
+ * channel with a decode error: txFlush() and next tx() throw. Areas outside of the
+ * bound DMA buffer (or of the ring area) and lengths not fitting LENGTH register
+ * are rejected before any transfer is programmed.
+ */
+#include "testutil.h"
+
+#define NDESC     4
+#define BLOCKSIZE 4096
+
+int main(void) {
+
+   {
+      DMACtrlT<SimBackend> dmac = simController(BLOCKSIZE, false);
+
+      dmac.setChannel(DMACtrl::MM2S);
+      dmac.reset();
+      dmac.initDirect(BLOCKSIZE, TEST_MEMBASE);
+      dmac.run();
+
+      CHECK(throws([&]() { dmac.tx(0, BD_LENGTH_MASK + 1, 1000); }));
+
+      CHECK(dmac.tx(0, BLOCKSIZE, 1000));
+      CHECK(dmac.txFlush(100000));
+
+      // source area past simulated memory
+      CHECK(dmac.tx(BLOCKSIZE, BLOCKSIZE, 1000));
+      CHECK(throws([&]() { dmac.txFlush(100000); }));
+      CHECK(throws([&]() { dmac.tx(0, BLOCKSIZE, 1000); }));
+   }
+
+   {
+      // direct mode: data inside bound DMA buffer
+      FakeUdmabuf udmabuf;
+      DMABuffer dbuf;
+      DMACtrlT<SimBackend> dmac = simController(2 * BLOCKSIZE, false);
+
+      udmabuf.add("udmabuf0", TEST_MEMBASE, 2 * BLOCKSIZE);
+      CHECK(udmabuf.open(dbuf, "udmabuf0", false));
+
+      dmac.setChannel(DMACtrl::MM2S);
+      dmac.reset();
+      dmac.initDirect(BLOCKSIZE, TEST_MEMBASE + BLOCKSIZE);
+      dmac.setBuffer(dbuf);
+      dmac.run();
+
+      CHECK(throws([&]() { dmac.tx(1, BLOCKSIZE, 1000); }));
+      CHECK(throws([&]() { dmac.tx(UINT32_MAX, 2, 1000); }));
+      CHECK(dmac.tx(0, BLOCKSIZE, 1000));
+      CHECK(dmac.txFlush(100000));
+   }
+
+   {
+      // scatter-gather mode without bound buffer: data inside ring area
+      DMACtrlT<SimBackend> dmac = simController(0x1000 + NDESC * BLOCKSIZE);
+
+      dmac.setChannel(DMACtrl::MM2S);
+      dmac.reset();
+      dmac.initSG(TEST_MEMBASE, NDESC, BLOCKSIZE, TEST_MEMBASE + 0x1000);
+      dmac.run();
+
+      CHECK(throws([&]() { dmac.tx((NDESC - 1) * BLOCKSIZE + 1, BLOCKSIZE, 1000); }));
+      CHECK(dmac.tx(BLOCKSIZE, (NDESC - 1) * BLOCKSIZE, 1000));
+      CHECK(dmac.txFlush(100000));
+   }
+
+   return 0;
+}
@@ -0,0 +1,105 @@
+/**
+ * @file
+ * @brief Interrupt driven rx() on fake UIO file descriptors
+ *
+ * A pipe stands in for the UIO device: a thread plays the interrupt line, writing
+ * a 4 bytes count on each simulated block completion, and rx() waits on it.
+ * A pending count is consumed by the wait (pipe and eventfd stand-ins), and a
+ * pipe closed by its writer makes rx() throw instead of spinning.
+ */
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+
+#include "testutil.h"
+
+#define DESCSIZE  0x1000
+#define NDESC     4
+#define BLOCKSIZE 4096
+
+// true if file descriptor has nothing to read
+static bool drained(int fd) {
+   struct pollfd pfd = { fd, POLLIN, 0 };
+   return (poll(&pfd, 1, 0) == 0);
+}
+
+int main(void) {
+
+   DMACtrlT<SimBackend> dmac = simController(DESCSIZE + NDESC * BLOCKSIZE);
+   SimBackend &sim = dmac.getBackend();
+   DMACtrl::BlockRange range;
+   int irq[2];
+
+   CHECK(pipe2(irq, O_NONBLOCK) == 0);
+
+   sim.setRate(400e3);
+
+   dmac.setChannel(DMACtrl::S2MM);
+   dmac.reset();
+   dmac.setCyclic(false);
+   dmac.initSG(TEST_MEMBASE, NDESC, BLOCKSIZE, TEST_MEMBASE + DESCSIZE);
+   dmac.setIrqFd(irq[0]);
+   CHECK(dmac.isIrqDriven());
+   dmac.run();
+
+   // interrupt line: a count for each completed block descriptor
+   std::atomic<bool> stop{false};
+   std::thread line([&]() {
+      uint64_t seen = 0;
+      uint32_t count = 0;
+      while(!stop) {
+         if(sim.getTransfers() != seen) {
+            seen = sim.getTransfers();
+            count++;
+            write(irq[1], &count, sizeof(count));
+         }
+         std::this_thread::sleep_for(std::chrono::microseconds(100));
+      }
+   });
+
+   uint64_t blocks = 0;
+   for(int i=0; i<2*NDESC; i++) {
+      CHECK(dmac.rx());
+      range = dmac.getBlockRange();
+      CHECK(range.first == blocks % NDESC);
+      blocks += range.last - range.first + 1;
+      dmac.release(range);
+   }
+
+   stop = true;
+   line.join();
+
+   // hold whole ring: no more completions
+   while(dmac.rx(50000))
+      ;
+
+   // pending count is consumed by the wait
+   uint32_t count = 1;
+   CHECK(write(irq[1], &count, sizeof(count)) == sizeof(count));
+   CHECK(!dmac.rx(20000));
+   CHECK(drained(irq[0]));
+
+   // eventfd stand-in: 8 bytes counter
+   int evfd = eventfd(0, EFD_NONBLOCK);
+   CHECK(evfd >= 0);
+   dmac.setIrqFd(evfd);
+   uint64_t one = 1;
+   CHECK(write(evfd, &one, sizeof(one)) == sizeof(one));
+   CHECK(!dmac.rx(20000));
+   CHECK(drained(evfd));
+
+   // interrupt source gone
+   dmac.setIrqFd(irq[0]);
+   close(irq[1]);
+   CHECK(throws([&]() { dmac.rx(20000); }));
+
+   dmac.setIrqFd(-1);
+   close(irq[0]);
+   close(evfd);
+
+   return 0;
+}